@@ -0,0 +1,153 @@
+/*
+ * arena.c - region allocator on top of the mm malloc package
+ *
+ * An arena hands out memory by bumping a pointer through a list of
+ * chunks it gets from mm_malloc. Objects are never freed one at a time:
+ * arena_reset frees them all at once by rewinding the pointer to the
+ * first chunk, and the chunks are filled again in order before the arena
+ * asks mm_malloc for more. arena_destroy gives every chunk back to
+ * mm_free, one call per chunk rather than one per object.
+ *
+ * Requests bigger than a quarter of a chunk get a chunk of their own,
+ * so that they do not waste the rest of the current one. These go back
+ * to mm_free on every reset.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+#include "arena.h"
+#include "config.h"
+
+/* Default chunk size (bytes). Chunks this big get mappings of their own
+   from mm.c, so kept chunks do not pin heap blocks between the large ones
+   freed on every reset, and the pages of a chunk not used yet are never
+   touched */
+#define ARENA_CHUNKSIZE (1<<20)
+
+/* Round size up to the payload alignment */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+/* Every chunk starts with a header linking it to the next one */
+typedef struct chunk {
+  struct chunk *next;           /* Next chunk of the list */
+  size_t size;                  /* Chunk size, header included (bytes) */
+} chunk_t;
+
+#define CHUNK_HDRSIZE ALIGN(sizeof(chunk_t))
+
+struct arena {
+  chunk_t *chunks;              /* First chunk */
+  chunk_t *cur;                 /* Chunk the objects are taken from */
+  chunk_t *large;               /* Chunks of the large requests */
+  char *ptr;                    /* Next free byte of the current chunk */
+  char *end;                    /* End of the current chunk */
+  size_t chunksize;             /* Size of a normal chunk (bytes) */
+};
+
+static chunk_t *new_chunk(chunk_t **linkp, size_t size);
+static void free_chunks(chunk_t *c);
+
+/*
+ * arena_create - Make an empty arena cutting chunks of chunksize bytes,
+ *     or of ARENA_CHUNKSIZE bytes if chunksize is 0
+ */
+arena_t *arena_create(size_t chunksize)
+{
+  arena_t *a;
+
+  if ((a = mm_malloc(sizeof(arena_t))) == NULL)
+    return NULL;
+  a->chunks = a->cur = a->large = NULL;
+  a->ptr = a->end = NULL;
+  a->chunksize = chunksize ? ALIGN(chunksize) : ARENA_CHUNKSIZE;
+  if (a->chunksize < 2*CHUNK_HDRSIZE)
+    a->chunksize = 2*CHUNK_HDRSIZE;
+  return a;
+}
+
+/*
+ * arena_alloc - Allocate size bytes from arena a
+ */
+void *arena_alloc(arena_t *a, size_t size)
+{
+  chunk_t *c;
+  char *p;
+
+  size = ALIGN(size);
+  if (size <= (size_t)(a->end - a->ptr)) {
+    p = a->ptr;
+    a->ptr += size;
+    return p;
+  }
+
+  if (size > (a->chunksize - CHUNK_HDRSIZE) / 4) {
+    if ((c = new_chunk(&a->large, CHUNK_HDRSIZE + size)) == NULL)
+      return NULL;
+    return (char *)c + CHUNK_HDRSIZE;
+  }
+
+  /* Move on to the next chunk, which is new unless the arena has been
+     reset. The rest of the current chunk is left unused */
+  if ((c = a->cur ? a->cur->next : a->chunks) == NULL &&
+      (c = new_chunk(a->cur ? &a->cur->next : &a->chunks, a->chunksize)) == NULL)
+    return NULL;
+  a->cur = c;
+  p = (char *)c + CHUNK_HDRSIZE;
+  a->ptr = p + size;
+  a->end = (char *)c + c->size;
+  return p;
+}
+
+/*
+ * arena_reset - Free every object of arena a. The chunks are kept for
+ *     the objects allocated next.
+ */
+void arena_reset(arena_t *a)
+{
+  free_chunks(a->large);
+  a->large = NULL;
+  if ((a->cur = a->chunks) != NULL) {
+    a->ptr = (char *)a->cur + CHUNK_HDRSIZE;
+    a->end = (char *)a->cur + a->cur->size;
+  }
+}
+
+/*
+ * arena_destroy - Free arena a with all its objects
+ */
+void arena_destroy(arena_t *a)
+{
+  free_chunks(a->large);
+  free_chunks(a->chunks);
+  mm_free(a);
+}
+
+/*
+ * new_chunk - Allocate a chunk of size bytes and link it in at *linkp
+ */
+static chunk_t *new_chunk(chunk_t **linkp, size_t size)
+{
+  chunk_t *c;
+
+  if ((c = mm_malloc(size)) == NULL)
+    return NULL;
+  c->next = *linkp;
+  c->size = size;
+  *linkp = c;
+  return c;
+}
+
+/*
+ * free_chunks - Give chunk c and the chunks after it back to mm_free
+ */
+static void free_chunks(chunk_t *c)
+{
+  chunk_t *next;
+
+  for (; c != NULL; c = next) {
+    next = c->next;
+    mm_free(c);
+  }
+}
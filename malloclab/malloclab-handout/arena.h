@@ -0,0 +1,11 @@
+/*
+ * arena.h - region allocator on top of the mm malloc package
+ */
+#include <stdio.h>
+
+typedef struct arena arena_t;
+
+extern arena_t *arena_create(size_t chunksize);
+extern void *arena_alloc(arena_t *a, size_t size);
+extern void arena_reset(arena_t *a);
+extern void arena_destroy(arena_t *a);
@@ -58,9 +58,13 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes. Build with "make HEAP_MB=<n>" for a heap
+ * of n MB instead (after "make clean"). It must stay a plain unsigned
+ * long constant, without casts, so that #if can test it.
  */
-#define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#ifndef MAX_HEAP
+#define MAX_HEAP (20UL << 20)  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
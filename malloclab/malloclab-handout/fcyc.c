@@ -13,6 +13,7 @@
 
 #include "fcyc.h"
 #include "clock.h"
+#include "perfctr.h"
 
 /* Default values */
 #define K 3                  /* Value of K in K-best scheme */
@@ -167,6 +168,44 @@ double fcyc(test_funct f, void *argp)
     return result;  
 }
 
+/*
+ * fcyc_events - Use K-best scheme to estimate the running time of
+ *     function f, counting hardware events around each run with the
+ *     counters of perfctr.c, which must be open. Store the events of
+ *     the fastest run in counts. Runs are timed by the cycle counter
+ *     of perfctr.c where there is one, and by clock.c otherwise.
+ */
+double fcyc_events(test_funct f, void *argp, double *counts)
+{
+    double cyc, result, run[PERF_EVENTS];
+    int i;
+
+    init_sampler();
+    for (i = 0; i < PERF_EVENTS; i++)
+	counts[i] = -1;
+    do {
+	if (clear_cache)
+	    clear();
+	start_counter();
+	perf_start();
+	f(argp);
+	perf_stop(run);
+	cyc = get_counter();
+	if (run[PERF_CYCLES] >= 0)
+	    cyc = run[PERF_CYCLES];
+	if (samplecount == 0 || cyc < values[0])
+	    for (i = 0; i < PERF_EVENTS; i++)
+		counts[i] = run[i];
+	add_sample(cyc);
+    } while (!has_converged() && samplecount < maxsamples);
+    result = values[0];
+#if !KEEP_VALS
+    free(values); 
+    values = NULL;
+#endif
+    return result;
+}
+
 
 /*************************************************************
  * Set the various parameters used by the measurement routines 
@@ -13,6 +13,10 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Compute number of cycles used by test function f as fcyc does, and
+   store the hardware events (see perfctr.h) of the fastest run in counts */
+double fcyc_events(test_funct f, void *argp, double *counts);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
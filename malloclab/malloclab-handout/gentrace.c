@@ -0,0 +1,407 @@
+/*
+ * gentrace - Generate a synthetic trace file for stress and scaling
+ *     studies of the malloc packages
+ *
+ * usage: gentrace [-r] [-n <allocs>] [-l <live>] [-s <sizes>]
+ *                 [-L <lifetimes>] [-g <prob>:<factor>] [-S <seed>] <out>
+ *
+ * The trace makes n allocations, one per tick of its clock. Each block
+ * gets a size from the size distribution and a lifetime in ticks from
+ * the lifetime distribution, whose mean is the live set: as many blocks
+ * as that are live at any time once the trace is under way. A block is
+ * freed at the first tick past its lifetime, and the blocks still live
+ * after the last allocation are freed at the end in the same order.
+ * With -g, each tick also grows a random live block by the factor with
+ * the given probability, as a buffer or vector growing by realloc does.
+ *
+ * Sizes (-s), in bytes:
+ *     uniform:<min>:<max>          uniformly between min and max
+ *     power:<min>:<max>:<alpha>    power law: P(size > x) ~ x^-alpha
+ *     bimodal:<small>:<large>:<p>  small, or large with probability p,
+ *                                  each give or take a quarter
+ *     trace:<file>                 the sizes a trace file allocates,
+ *                                  e.g. one recorded with rec2rep
+ *
+ * Lifetimes (-L), all with the live set as mean:
+ *     const                        every block the same: first in, first out
+ *     exp                          exponential: a block is as likely to
+ *                                  be freed at any tick
+ *     uniform                      uniformly up to twice the live set
+ *     pareto:<alpha>               heavy tailed, alpha > 1: most blocks
+ *                                  die young, a few live very long
+ *
+ * The trace is written as a binary trace file, or with -r as a .rep
+ * file. The default is 100000 allocations, 10000 live blocks, sizes
+ * power:16:4096:1.5 and exp lifetimes. Traces of millions of blocks
+ * need a bigger heap: build mdriver with "make HEAP_MB=<n>".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "trace.h"
+
+int verbose = 0;     /* read by read_trace */
+
+/* A live block, in the heap of blocks by the tick at which they die */
+typedef struct {
+    long long death;  /* tick of the free */
+    int id;           /* block id */
+} death_t;
+
+/* Size distributions */
+enum {SIZE_UNIFORM, SIZE_POWER, SIZE_BIMODAL, SIZE_TRACE};
+
+/* Lifetime distributions */
+enum {LIFE_CONST, LIFE_EXP, LIFE_UNIFORM, LIFE_PARETO};
+
+static int size_kind = SIZE_POWER;
+static double size_a = 16, size_b = 4096, size_c = 1.5; /* its parameters */
+static int *trace_sizes;      /* the sizes of trace:<file> */
+static int num_trace_sizes;
+
+static int life_kind = LIFE_EXP;
+static double life_alpha;     /* of pareto:<alpha> */
+
+static unsigned long long seed = 1;
+
+static trace_t trace;         /* the trace being built */
+static int max_ops;           /* room in trace.ops */
+static int *sizes;            /* size of each block, by id */
+static int *live, *live_pos;  /* the live blocks, and where each is in live */
+static int num_live;
+static long long live_bytes, peak_bytes;
+
+static death_t *deaths;       /* binary heap of the live blocks by death */
+static int num_deaths;
+
+static void parse_sizes(char *arg);
+static void parse_lifetimes(char *arg);
+static void read_sizes(char *path);
+static int next_size(void);
+static long long next_lifetime(double mean);
+static double uniform(void);
+static void emit(int type, int id, int size);
+static void push_death(long long death, int id);
+static death_t pop_death(void);
+static void *xmalloc(size_t size);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c, id, text = 0;
+    int allocs = 100000, target = 10000;
+    double grow_prob = 0, grow_factor = 2;
+    long long tick, newsize;
+    death_t d;
+
+    while ((c = getopt(argc, argv, "rn:l:s:L:g:S:h")) != EOF) {
+	switch (c) {
+	case 'r': /* Write a .rep file */
+	    text = 1;
+	    break;
+	case 'n': /* Allocations */
+	    allocs = atoi(optarg);
+	    break;
+	case 'l': /* Live blocks, the mean lifetime */
+	    target = atoi(optarg);
+	    break;
+	case 's': /* Size distribution */
+	    parse_sizes(optarg);
+	    break;
+	case 'L': /* Lifetime distribution */
+	    parse_lifetimes(optarg);
+	    break;
+	case 'g': /* Probability of growing a block at each tick, and by what */
+	    if (sscanf(optarg, "%lf:%lf", &grow_prob, &grow_factor) != 2 ||
+		grow_prob < 0 || grow_prob > 1 || grow_factor <= 1)
+		usage();
+	    break;
+	case 'S': /* Seed of the random numbers */
+	    seed = strtoull(optarg, NULL, 0) | 1;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 1 || allocs < 1 || target < 1)
+	usage();
+
+    max_ops = 2 * allocs + 1024;
+    trace.ops = xmalloc(max_ops * sizeof(traceop_t));
+    sizes = xmalloc(allocs * sizeof(int));
+    live = xmalloc(allocs * sizeof(int));
+    live_pos = xmalloc(allocs * sizeof(int));
+    deaths = xmalloc(allocs * sizeof(death_t));
+
+    for (tick = 0; tick < allocs; tick++) {
+	/* Free the blocks whose time has come */
+	while (num_deaths > 0 && deaths[0].death <= tick) {
+	    d = pop_death();
+	    emit(FREE, d.id, 0);
+	}
+
+	/* Allocate one */
+	id = trace.num_ids++;
+	sizes[id] = next_size();
+	emit(ALLOC, id, sizes[id]);
+	push_death(tick + next_lifetime(target), id);
+
+	/* Maybe grow a live block */
+	if (grow_prob > 0 && uniform() < grow_prob) {
+	    id = live[(int)(uniform() * num_live)];
+	    newsize = (long long)(sizes[id] * grow_factor);
+	    if (newsize > 0x7fffffff)
+		newsize = 0x7fffffff;
+	    emit(REALLOC, id, (int)newsize);
+	}
+    }
+    while (num_deaths > 0) {
+	d = pop_death();
+	emit(FREE, d.id, 0);
+    }
+
+    trace.sugg_heapsize = peak_bytes > 0x7fffffff ? 0x7fffffff : peak_bytes;
+    trace.weight = 1;
+    if (write_trace(&trace, argv[optind], text) < 0) {
+	perror(argv[optind]);
+	exit(1);
+    }
+    fprintf(stderr, "%d blocks, %d requests, peak of %lld live bytes\n",
+	    trace.num_ids, trace.num_ops, peak_bytes);
+    exit(0);
+}
+
+/*
+ * parse_sizes - Set the size distribution from its -s argument
+ */
+static void parse_sizes(char *arg)
+{
+    if (sscanf(arg, "uniform:%lf:%lf", &size_a, &size_b) == 2)
+	size_kind = SIZE_UNIFORM;
+    else if (sscanf(arg, "power:%lf:%lf:%lf", &size_a, &size_b, &size_c) == 3)
+	size_kind = SIZE_POWER;
+    else if (sscanf(arg, "bimodal:%lf:%lf:%lf", &size_a, &size_b, &size_c) == 3)
+	size_kind = SIZE_BIMODAL;
+    else if (strncmp(arg, "trace:", 6) == 0) {
+	size_kind = SIZE_TRACE;
+	read_sizes(arg + 6);
+	return;
+    }
+    else
+	usage();
+    if (size_a < 1 || size_b < size_a || size_b > 0x7fffffff ||
+	(size_kind == SIZE_POWER && size_c <= 0) ||
+	(size_kind == SIZE_BIMODAL && (size_c < 0 || size_c > 1)))
+	usage();
+}
+
+/*
+ * parse_lifetimes - Set the lifetime distribution from its -L argument
+ */
+static void parse_lifetimes(char *arg)
+{
+    if (strcmp(arg, "const") == 0)
+	life_kind = LIFE_CONST;
+    else if (strcmp(arg, "exp") == 0)
+	life_kind = LIFE_EXP;
+    else if (strcmp(arg, "uniform") == 0)
+	life_kind = LIFE_UNIFORM;
+    else if (sscanf(arg, "pareto:%lf", &life_alpha) == 1 && life_alpha > 1)
+	life_kind = LIFE_PARETO;
+    else
+	usage();
+}
+
+/*
+ * read_sizes - Collect the sizes that the requests of a trace file
+ *     allocate, for trace:<file>
+ */
+static void read_sizes(char *path)
+{
+    trace_t *t = read_trace("", path);
+    int i;
+
+    trace_sizes = xmalloc((t->num_ops + 1) * sizeof(int));
+    for (i = 0; i < t->num_ops; i++) {
+	switch (t->ops[i].type) {
+	case ALLOC:
+	case REALLOC:
+	case MEMALIGN:
+	case BALLOC:   /* a batch weighs as one request */
+	    trace_sizes[num_trace_sizes++] = t->ops[i].size;
+	    break;
+	default:
+	    break;
+	}
+    }
+    free_trace(t);
+    if (num_trace_sizes == 0) {
+	fprintf(stderr, "gentrace: %s allocates nothing\n", path);
+	exit(1);
+    }
+}
+
+/*
+ * next_size - Draw the size of a block
+ */
+static int next_size(void)
+{
+    double u = uniform(), s, la, ha;
+
+    switch (size_kind) {
+    case SIZE_UNIFORM:
+	s = size_a + u * (size_b - size_a + 1);
+	break;
+    case SIZE_POWER:  /* inverse of the bounded Pareto distribution */
+	la = pow(size_a, -size_c);
+	ha = pow(size_b, -size_c);
+	s = pow(la - u * (la - ha), -1 / size_c);
+	break;
+    case SIZE_BIMODAL:
+	s = (u < size_c) ? size_b : size_a;
+	s *= 0.75 + 0.5 * uniform();
+	break;
+    default:
+	return trace_sizes[(int)(u * num_trace_sizes)];
+    }
+    if (s < 1)
+	return 1;
+    return s > 0x7fffffff ? 0x7fffffff : (int)s;
+}
+
+/*
+ * next_lifetime - Draw the lifetime of a block in ticks, at least 1
+ */
+static long long next_lifetime(double mean)
+{
+    double u = uniform(), t;
+
+    switch (life_kind) {
+    case LIFE_CONST:
+	t = mean;
+	break;
+    case LIFE_EXP:
+	t = -mean * log(1 - u);
+	break;
+    case LIFE_UNIFORM:
+	t = 2 * mean * u;
+	break;
+    default:  /* the Pareto minimum that gives this mean */
+	t = mean * (life_alpha - 1) / life_alpha * pow(1 - u, -1 / life_alpha);
+	break;
+    }
+    return (t < 1) ? 1 : (t > 1e15) ? (long long)1e15 : (long long)t;
+}
+
+/*
+ * uniform - Return a random number in [0, 1), from an xorshift64*
+ *     generator, so that a seed gives the same trace everywhere
+ */
+static double uniform(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return ((seed * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / (1ULL << 53));
+}
+
+/*
+ * emit - Append a request to the trace, keeping track of the live
+ *     blocks and bytes
+ */
+static void emit(int type, int id, int size)
+{
+    traceop_t *op;
+    int last;
+
+    if (trace.num_ops == max_ops) {
+	max_ops *= 2;
+	if ((trace.ops = realloc(trace.ops, max_ops * sizeof(traceop_t))) == NULL) {
+	    fprintf(stderr, "gentrace: out of memory\n");
+	    exit(1);
+	}
+    }
+    op = &trace.ops[trace.num_ops++];
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    op->index = id;
+    op->size = size;
+
+    switch (type) {
+    case ALLOC:
+	live_pos[id] = num_live;
+	live[num_live++] = id;
+	live_bytes += size;
+	break;
+    case REALLOC:
+	live_bytes += size - sizes[id];
+	sizes[id] = size;
+	break;
+    case FREE:
+	last = live[--num_live];
+	live[live_pos[id]] = last;
+	live_pos[last] = live_pos[id];
+	live_bytes -= sizes[id];
+	break;
+    }
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+}
+
+/*
+ * push_death, pop_death - Add a block to the heap of deaths, and take
+ *     out the one that dies first
+ */
+static void push_death(long long death, int id)
+{
+    int i = num_deaths++, parent;
+
+    while (i > 0 && deaths[parent = (i - 1) / 2].death > death) {
+	deaths[i] = deaths[parent];
+	i = parent;
+    }
+    deaths[i].death = death;
+    deaths[i].id = id;
+}
+
+static death_t pop_death(void)
+{
+    death_t top = deaths[0], last = deaths[--num_deaths];
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < num_deaths) {
+	if (child + 1 < num_deaths &&
+	    deaths[child + 1].death < deaths[child].death)
+	    child++;
+	if (deaths[child].death >= last.death)
+	    break;
+	deaths[i] = deaths[child];
+	i = child;
+    }
+    deaths[i] = last;
+    return top;
+}
+
+static void *xmalloc(size_t size)
+{
+    void *p;
+
+    if ((p = malloc(size)) == NULL) {
+	fprintf(stderr, "gentrace: out of memory\n");
+	exit(1);
+    }
+    return p;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: gentrace [-r] [-n <allocs>] [-l <live>] [-s <sizes>]\n"
+	    "                [-L <lifetimes>] [-g <prob>:<factor>] [-S <seed>] <out>\n"
+	    "sizes: uniform:<min>:<max>, power:<min>:<max>:<alpha>,\n"
+	    "       bimodal:<small>:<large>:<p>, trace:<file>\n"
+	    "lifetimes: const, exp, uniform, pareto:<alpha>\n");
+    exit(1);
+}
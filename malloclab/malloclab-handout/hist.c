@@ -0,0 +1,89 @@
+/*
+ * hist.c - Log-linear histograms in the style of HdrHistogram, for
+ *     recording the latencies of single allocator calls
+ *
+ * Recording a value is a few shifts and an increment, so the driver
+ * can afford to do it around every call it times.
+ */
+#include <string.h>
+
+#include "hist.h"
+
+#define SUB_COUNT (1 << HIST_SUB_BITS)   /* values with a bucket each */
+#define HALF_COUNT (SUB_COUNT >> 1)      /* buckets per power of two above */
+
+/*
+ * bucket_of - Return the index of the bucket that holds value v
+ */
+static int bucket_of(unsigned long long v)
+{
+    int shift;
+
+    if (v < SUB_COUNT)
+	return (int) v;
+    shift = 64 - __builtin_clzll(v) - HIST_SUB_BITS;
+    return SUB_COUNT + (shift - 1) * HALF_COUNT + (int) (v >> shift) - HALF_COUNT;
+}
+
+/*
+ * bucket_high - Return the highest value that falls into bucket i
+ */
+static unsigned long long bucket_high(int i)
+{
+    int shift;
+
+    if (i < SUB_COUNT)
+	return i;
+    shift = (i - SUB_COUNT) / HALF_COUNT + 1;
+    return (((unsigned long long) (i - SUB_COUNT) % HALF_COUNT + HALF_COUNT + 1)
+	    << shift) - 1;
+}
+
+void hist_clear(hist_t *h)
+{
+    memset(h, 0, sizeof(hist_t));
+}
+
+void hist_record(hist_t *h, unsigned long long v)
+{
+    h->buckets[bucket_of(v)]++;
+    h->count++;
+    if (v > h->max)
+	h->max = v;
+}
+
+void hist_merge(hist_t *dst, hist_t *src)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+	dst->buckets[i] += src->buckets[i];
+    dst->count += src->count;
+    if (src->max > dst->max)
+	dst->max = src->max;
+}
+
+/*
+ * hist_quantile - Return the value below which a fraction q of the
+ *     values in h lie, rounded up to the top of its bucket but never
+ *     above the largest value recorded
+ */
+unsigned long long hist_quantile(hist_t *h, double q)
+{
+    unsigned long rank, seen = 0;
+    unsigned long long high;
+    int i;
+
+    if (h->count == 0)
+	return 0;
+    rank = (unsigned long) (q * h->count + 0.5);
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += h->buckets[i];
+	if (seen >= rank)
+	    break;
+    }
+    high = bucket_high(i);
+    return high < h->max ? high : h->max;
+}
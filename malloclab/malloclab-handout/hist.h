@@ -0,0 +1,30 @@
+/*
+ * hist.h - prototypes for the latency histograms in hist.c
+ */
+
+/*
+ * Values below 2^HIST_SUB_BITS get a bucket each; every power of two
+ * above that is split into 2^(HIST_SUB_BITS-1) buckets, so a value is
+ * known to within 1/64th of itself whatever its magnitude.
+ */
+#define HIST_SUB_BITS 7
+#define HIST_BUCKETS  ((1 << HIST_SUB_BITS) + \
+		       (64 - HIST_SUB_BITS) * (1 << (HIST_SUB_BITS - 1)))
+
+typedef struct {
+    unsigned long count;                   /* number of values recorded */
+    unsigned long long max;                /* largest value recorded */
+    unsigned long buckets[HIST_BUCKETS];   /* values in each bucket */
+} hist_t;
+
+/* Forget all the values recorded in h */
+void hist_clear(hist_t *h);
+
+/* Record value v in h */
+void hist_record(hist_t *h, unsigned long long v);
+
+/* Add all the values recorded in src to dst */
+void hist_merge(hist_t *dst, hist_t *src);
+
+/* Return the value below which a fraction q of the values in h lie */
+unsigned long long hist_quantile(hist_t *h, double q);
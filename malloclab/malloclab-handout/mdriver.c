@@ -15,10 +15,18 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <sched.h>
+#include <pthread.h>
 
 #include "mm.h"
+#include "arena.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "fcyc.h"
+#include "perfctr.h"
+#include "clock.h"
+#include "hist.h"
+#include "trace.h"
 #include "config.h"
 
 /**********************
@@ -28,40 +36,36 @@
 /* Misc */
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
+#define OPTYPES        6 /* number of request types in traceop_t */
+
+/* Bytes a request allocates in the -r replay before it is torn down */
+#define REQUEST_BYTES (MAX_HEAP / 8)
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Runs of the -T threaded replay, of which the fastest is reported */
+#define THREAD_RUNS 3
+
+/* Requests between samples of the resident heap pages, at the least */
+#define RSS_EVERY 1024
+
+/* Free block sizes in the -U timeline: up to 16, 32, ..., 64K, more */
+#define FREE_CLASSES 14
+
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, in a splay tree by lo */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below lo */
+    struct range_t *right; /* ranges above hi */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -70,6 +74,7 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    char **objs;     /* blocks of the current request in the -r replay */
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
@@ -81,20 +86,93 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double rss_peak; /* most heap bytes resident at once (0 for libc) */
+    double rss_end;  /* heap bytes resident at the end of the trace */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/*
+ * Holds the state of one thread of the -T threaded replay. Under
+ * remote frees, a thread passes each block it frees to the next thread,
+ * which frees it; the inbox never wraps, as it has room for every free
+ * in the trace.
+ */
+typedef struct thread_t {
+    trace_t *trace;           /* the trace every thread replays */
+    char **blocks;            /* this thread's blocks, by id */
+    char **inbox;             /* blocks passed to this thread to free */
+    int inbox_tail;           /* blocks passed so far, set by the sender */
+    int inbox_head;           /* blocks of the inbox freed so far */
+    int done;                 /* has the thread replayed the whole trace? */
+    int failed;               /* did the package run out of memory? */
+    struct thread_t *next;    /* where its frees go, itself unless remote */
+    struct thread_t *prev;    /* the thread whose frees come to it */
+    pthread_barrier_t *start; /* lets all the threads go at once */
+    struct timespec t0, t1;   /* when the thread started and finished */
+    pthread_t tid;
+} thread_t;
+
+/* Sums up the stats of one malloc package over all the traces */
+typedef struct {
+    double util;      /* average space utilization */
+    double thru;      /* average throughput in ops/sec */
+    double perfindex; /* performance index out of 100 */
+    int errors;       /* number of errs found when running the package */
+} summary_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
+static int split_batches = 0; /* run batch requests one block at a time */
 static int errors = 0;  /* number of errs found when running student malloc */
+static FILE *timeline = NULL; /* CSV the heap is sampled into (set by -U) */
+static int timeline_every = 1; /* requests between samples (set by -u) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
+/*
+ * The malloc packages to evaluate. mdriver-all links every variant,
+ * each built with its entry points prefixed, behind the one driver.
+ */
+#ifdef MM_ALL
+extern mm_ops_t tlsf_mm_ops, mt_mm_ops, buddy_mm_ops;
+extern mm_ops_t seg_mm_ops, exp_mm_ops, imp_mm_ops;
+static mm_ops_t *packages[] = {
+    &mm_ops, &tlsf_mm_ops, &mt_mm_ops, &buddy_mm_ops,
+    &seg_mm_ops, &exp_mm_ops, &imp_mm_ops, NULL
+};
+#else
+static mm_ops_t *packages[] = {&mm_ops, NULL};
+#endif
+static mm_ops_t *mm = &mm_ops; /* the package under evaluation */
+
+/* libc malloc behind the same interface, for the -T threaded replay */
+static int libc_init(void);
+static void *libc_memalign(size_t align, size_t size);
+static size_t libc_malloc_batch(size_t size, size_t n, void **ptrs);
+static void libc_free_batch(void **ptrs, size_t n);
+static mm_ops_t libc_ops = {
+    "libc", "-", "-", "-", libc_init, malloc, free, realloc, libc_memalign,
+    libc_malloc_batch, libc_free_batch, NULL, 1
+};
+
+/* The free blocks seen by one heap walk of the -U timeline */
+static struct {
+    size_t count;                /* number of free blocks */
+    size_t bytes;                /* their total size */
+    size_t largest;              /* the largest of them */
+    size_t sizes[FREE_CLASSES];  /* how many in each size class */
+} free_seen;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Names of the request types, for the -L latency tables */
+static char *op_names[OPTYPES] = {
+    "malloc", "free", "realloc", "malloc_batch", "free_batch", "memalign"
+};
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -105,15 +183,12 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
-
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
+static range_t *splay_range(range_t *t, char *lo);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -122,11 +197,48 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *rss_peak, double *rss_end);
 static void eval_mm_speed(void *ptr);
+static int batch_malloc(int size, int n, char **ptrs);
+
+/* Routines for sampling the heap into the -U timeline */
+static void open_timeline(char *path);
+static void sample_heap(int tracenum, int opnum, int total_size);
+static void visit_free(size_t size);
+static void batch_free(char **ptrs, int n);
+
+/* Routines for timing the calls of the mm package one at a time */
+static void eval_mm_latency(trace_t *trace, hist_t *hists);
+static void printlatency(char *label, hist_t *hists);
+
+/* Routines for comparing arena reset with per-object free */
+static void replay_requests(trace_t *trace, char **objs, arena_t *arena);
+static void eval_free_speed(void *ptr);
+static void eval_arena_speed(void *ptr);
+static int count_allocs(trace_t *trace);
+
+/* Routines for replaying traces from several threads at once */
+static void eval_threads(char **tracefiles, int num_tracefiles, 
+			 stats_t *stats, int maxthreads);
+static double eval_threads_speed(trace_t *trace, int nthreads, int remote);
+static void printthreads(char *label, int rows, int *threads, double *ops,
+			 double secs[][2]);
+static void *replay_thread(void *ptr);
+static void pass_block(thread_t *thread, char *p);
+static void drain_inbox(thread_t *thread);
+static int count_frees(trace_t *trace);
+
+/* Routines for counting hardware events */
+static void eval_events(char **tracefiles, int num_tracefiles, 
+			stats_t *stats);
+static void printevents(char *label, double ops, double secs, 
+			double *counts);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printpackages(summary_t *summary, int n,
+			  stats_t *libc_stats, int num_tracefiles);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -137,7 +249,7 @@ static void app_error(char *msg);
  **************/
 int main(int argc, char **argv)
 {
-    int i;
+    int i, j;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
@@ -145,11 +257,25 @@ int main(int argc, char **argv)
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t *stats;            /* mm stats of the current package */
+    summary_t *summary = NULL; /* aggregate stats for each mm package */
+    int p, npackages;          /* current package, number of packages */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int run_arena = 0;   /* If set, compare arena reset to free (set by -r) */
+    int run_pages = 0;   /* If set, compare huge and base pages (set by -p) */
+    int run_latency = 0; /* If set, time every call on its own (set by -L) */
+    int maxthreads = 0;  /* If set, replay from up to this many threads (-T) */
+    int run_events = 0;  /* If set, count hardware events (set by -H) */
+    hist_t *trace_hists = NULL; /* latencies by request type in a trace */
+    hist_t *total_hists = NULL; /* ... and in all the traces */
+    char label[MAXLINE];
+    int pages;
+    double free_secs, arena_secs, base_secs, huge_secs;
+    static char *page_names[] = {"base", "transparent huge", "hugetlb"};
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +284,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgalbrpHLT:U:u:")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +310,36 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'b': /* Split batch requests into single mallocs and frees */
+            split_batches = 1;
+            break;
+        case 'r': /* Compare arena reset with per-object free */
+            run_arena = 1;
+            break;
+        case 'p': /* Compare a heap of huge pages with one of base pages */
+            run_pages = 1;
+            break;
+        case 'H': /* Count hardware events, such as cache misses */
+            run_events = 1;
+            break;
+        case 'L': /* Print latency percentiles of each request type */
+            run_latency = 1;
+            break;
+        case 'T': /* Replay the traces from 1 up to this many threads */
+            if ((maxthreads = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'U': /* Sample the heap into a CSV timeline */
+            open_timeline(optarg);
+            break;
+        case 'u': /* Requests between the samples of the timeline */
+            if ((timeline_every = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -274,116 +430,248 @@ int main(int argc, char **argv)
     }
 
     /*
-     * Always run and evaluate the student's mm package
+     * Always run and evaluate the student's mm package, followed by
+     * any other packages linked into this driver
      */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
+    for (npackages = 0; packages[npackages] != NULL; npackages++)
+	;
 
     /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
+    mm_stats = (stats_t *)calloc(npackages * num_tracefiles, sizeof(stats_t));
+    summary = (summary_t *)calloc(npackages, sizeof(summary_t));
+    if (mm_stats == NULL || summary == NULL)
 	unix_error("mm_stats calloc in main failed");
+    if (run_latency) {
+	trace_hists = (hist_t *)malloc(OPTYPES * sizeof(hist_t));
+	total_hists = (hist_t *)malloc(OPTYPES * sizeof(hist_t));
+	if (trace_hists == NULL || total_hists == NULL)
+	    unix_error("hists malloc in main failed");
+    }
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
+    /* Open the hardware event counters, if the machine has any */
+    if (run_events && perf_open() == 0) {
+	printf("No hardware events to count (%s)\n\n", perf_error);
+	run_events = 0;
+    }
+
+    for (p=0; p < npackages; p++) {
+	mm = packages[p];
 	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
+	    printf("\nTesting %s malloc\n", mm->name);
+
+	/* Evaluate the malloc package using the K-best scheme */
+	stats = &mm_stats[p * num_tracefiles];
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    stats[i].ops = trace->num_ops;
 	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+		printf("Checking %s_malloc for correctness, ", mm->name);
+	    stats[i].valid = eval_mm_valid(trace, i, &ranges);
+	    if (stats[i].valid) {
+		if (verbose > 1)
+		    printf("efficiency, ");
+		stats[i].util = eval_mm_util(trace, i, &ranges,
+					     &stats[i].rss_peak,
+					     &stats[i].rss_end);
+		speed_params.trace = trace;
+		speed_params.ranges = ranges;
+		if (verbose > 1)
+		    printf("and performance.\n");
+		stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    }
+	    free_trace(trace);
 	}
-	free_trace(trace);
+	/* Display the mm results in a compact table */
+	if (verbose) {
+	    printf("\nResults for %s malloc:\n", mm->name);
+	    printresults(num_tracefiles, stats);
+	    printf("\n");
+	}
+	summary[p].errors = errors;
+	errors = 0;
+
+	/* Optionally time each call of the valid traces on its own */
+	if (run_latency) {
+	    printf("Latency in cycles for %s malloc:\n", mm->name);
+	    printf("%5s %-13s%10s%8s%8s%8s%10s\n",
+		   "trace", "op", "count", "p50", "p99", "p99.9", "max");
+	    for (i=0; i < OPTYPES; i++)
+		hist_clear(&total_hists[i]);
+	    for (i=0; i < num_tracefiles; i++) {
+		if (!stats[i].valid)
+		    continue;
+		trace = read_trace(tracedir, tracefiles[i]);
+		eval_mm_latency(trace, trace_hists);
+		sprintf(label, "%2d", i);
+		printlatency(label, trace_hists);
+		for (j=0; j < OPTYPES; j++)
+		    hist_merge(&total_hists[j], &trace_hists[j]);
+		free_trace(trace);
+	    }
+	    printlatency("all", total_hists);
+	    printf("\n");
+	}
+
+	/* Optionally count the hardware events of the valid traces */
+	if (run_events)
+	    eval_events(tracefiles, num_tracefiles, stats);
+
+	/* Optionally replay the valid traces from several threads at once */
+	if (maxthreads && mm->threads)
+	    eval_threads(tracefiles, num_tracefiles, stats, maxthreads);
+	else if (maxthreads)
+	    printf("No threaded replay of %s malloc: it is not thread-safe\n\n",
+		   mm->name);
     }
 
-    /* Display the mm results in a compact table */
-    if (verbose) {
-	printf("\nResults for mm malloc:\n");
-	printresults(num_tracefiles, mm_stats);
-	printf("\n");
+    /* Replay the traces through libc malloc from several threads too */
+    if (maxthreads && run_libc) {
+	mm = &libc_ops;
+	eval_threads(tracefiles, num_tracefiles, libc_stats, maxthreads);
     }
 
-    /* 
-     * Accumulate the aggregate statistics for the student's mm package 
+    /* The arena and page comparisons below run on the mm package */
+    mm = packages[0];
+
+    /*
+     * Optionally time the allocations of each trace torn down by freeing
+     * every block against torn down by resetting an arena
      */
-    secs = 0;
-    ops = 0;
-    util = 0;
-    numcorrect = 0;
-    for (i=0; i < num_tracefiles; i++) {
-	secs += mm_stats[i].secs;
-	ops += mm_stats[i].ops;
-	util += mm_stats[i].util;
-	if (mm_stats[i].valid)
-	    numcorrect++;
+    if (run_arena) {
+	printf("Arena reset vs per-object free:\n");
+	printf("%5s%12s%12s%9s\n", "trace", "free-secs", "reset-secs", "speedup");
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    speed_params.trace = trace;
+	    if ((speed_params.objs = 
+		 (char **)malloc(count_allocs(trace) * sizeof(char *))) == NULL)
+		unix_error("objs malloc in main failed");
+	    free_secs = fsecs(eval_free_speed, &speed_params);
+	    arena_secs = fsecs(eval_arena_speed, &speed_params);
+	    printf("%2d%15.6f%12.6f%8.2fx\n", 
+		   i, free_secs, arena_secs, free_secs / arena_secs);
+	    free(speed_params.objs);
+	    free_trace(trace);
+	}
+	printf("\n");
     }
-    avg_mm_util = util/num_tracefiles;
 
-    /* 
-     * Compute and print the performance index 
+    /*
+     * Optionally time each trace again with the heap backed by base
+     * pages and by huge pages
      */
-    if (errors == 0) {
-	avg_mm_throughput = ops/secs;
+    if (run_pages) {
+	mem_deinit();
+	pages = mem_init_pages(MEM_PAGES_HUGETLB);
+	printf("Huge pages vs base pages (heap of %lu MB on %s pages):\n",
+	       MAX_HEAP >> 20, page_names[pages]);
+	printf("%5s%12s%12s%9s\n", "trace", "base-secs", "huge-secs", "speedup");
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    speed_params.trace = trace;
+	    mem_deinit();
+	    mem_init_pages(MEM_PAGES_BASE);
+	    base_secs = fsecs(eval_mm_speed, &speed_params);
+	    mem_deinit();
+	    mem_init_pages(MEM_PAGES_HUGETLB);
+	    huge_secs = fsecs(eval_mm_speed, &speed_params);
+	    printf("%2d%15.6f%12.6f%8.2fx\n", 
+		   i, base_secs, huge_secs, base_secs / huge_secs);
+	    free_trace(trace);
+	}
+	printf("\n");
+    }
 
-	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
-	    p2 = (double)(1.0 - UTIL_WEIGHT);
-	} 
-	else {
-	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+    for (p=0; p < npackages; p++) {
+	if (npackages > 1)
+	    printf("%s: ", packages[p]->name);
+
+	/* 
+	 * Accumulate the aggregate statistics for the package 
+	 */
+	stats = &mm_stats[p * num_tracefiles];
+	secs = 0;
+	ops = 0;
+	util = 0;
+	numcorrect = 0;
+	for (i=0; i < num_tracefiles; i++) {
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	    if (stats[i].valid)
+		numcorrect++;
 	}
+	avg_mm_util = util/num_tracefiles;
+	avg_mm_throughput = ops/secs;
+
+	/* 
+	 * Compute and print the performance index 
+	 */
+	if (summary[p].errors == 0) {
+	    p1 = UTIL_WEIGHT * avg_mm_util;
+	    if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+		p2 = (double)(1.0 - UTIL_WEIGHT);
+	    } 
+	    else {
+		p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
+		    (avg_mm_throughput/AVG_LIBC_THRUPUT);
+	    }
 	
-	perfindex = (p1 + p2)*100.0;
-	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
-	       p1*100, 
-	       p2*100, 
-	       perfindex);
+	    perfindex = (p1 + p2)*100.0;
+	    printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
+		   p1*100, 
+		   p2*100, 
+		   perfindex);
 	
-    }
-    else { /* There were errors */
-	perfindex = 0.0;
-	printf("Terminated with %d errors\n", errors);
-    }
+	}
+	else { /* There were errors */
+	    perfindex = 0.0;
+	    printf("Terminated with %d errors\n", summary[p].errors);
+	}
+	summary[p].util = avg_mm_util;
+	summary[p].thru = avg_mm_throughput;
+	summary[p].perfindex = perfindex;
 
-    if (autograder) {
-	printf("correct:%d\n", numcorrect);
-	printf("perfidx:%.0f\n", perfindex);
+	if (autograder) {
+	    printf("correct:%d\n", numcorrect);
+	    printf("perfidx:%.0f\n", perfindex);
+	}
     }
 
+    /* Compare the packages side by side */
+    if (npackages > 1)
+	printpackages(summary, npackages, run_libc ? libc_stats : NULL,
+		      num_tracefiles);
+
     exit(0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. The payloads
+ * in the tree never overlap, so ordering them by lo orders them by hi
+ * too, and a new payload can only overlap its two neighbors.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree. 
  */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *t;
+    range_t *pred = NULL, *succ = NULL; /* neighbors of the payload */
     char msg[MAXLINE];
+    int i;
 
     assert(size > 0);
 
@@ -395,19 +683,35 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within
+       a region the package mapped with mem_map */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
+    /* 
+     * The payload must not overlap any other payloads. Splaying on lo
+     * brings up one neighbor of the payload, and splaying the subtree
+     * on the other side brings the other to the top of that subtree.
+     */
+    if ((t = *ranges = splay_range(*ranges, lo)) != NULL) {
+	if (t->lo <= lo) {
+	    pred = t;
+	    succ = t->right = splay_range(t->right, lo);
+	}
+	else {
+	    succ = t;
+	    pred = t->left = splay_range(t->left, lo);
+	}
+    }
+    for (i = 0; i < 2; i++) {
+	p = i ? succ : pred;
+        if (p != NULL && p->lo <= hi && p->hi >= lo) {
 	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
 		    lo, hi, p->lo, p->hi);
 	    malloc_error(tracenum, opnum, msg);
@@ -417,13 +721,23 @@ static int add_range(range_t **ranges, char *lo, int size,
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and making it the root of the tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
 	unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
+    p->left = p->right = NULL;
+    if (t != NULL && t->lo < lo) {
+	p->right = t->right;
+	p->left = t;
+	t->right = NULL;
+    }
+    else if (t != NULL) {
+	p->left = t->left;
+	p->right = t;
+	t->left = NULL;
+    }
     *ranges = p;
     return 1;
 }
@@ -434,18 +748,18 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
-    int size;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    if ((p = *ranges = splay_range(*ranges, lo)) == NULL || p->lo != lo)
+	return;
+
+    if (p->left == NULL)
+	*ranges = p->right;
+    else {
+	/* All ranges on the left are lower, so this brings up the highest */
+	*ranges = splay_range(p->left, lo);
+	(*ranges)->right = p->right;
     }
+    free(p);
 }
 
 /*
@@ -453,119 +767,84 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
+    range_t *p = *ranges;
     range_t *pnext;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+    /* Rotate left children up until the root has none, then free it */
+    while (p != NULL) {
+	if ((pnext = p->left) != NULL) {
+	    p->left = pnext->right;
+	    pnext->right = p;
+	}
+	else {
+	    pnext = p->right;
+	    free(p);
+	}
+	p = pnext;
     }
     *ranges = NULL;
 }
 
-
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
 /*
- * read_trace - read a trace file and store it in memory
+ * splay_range - Top-down splay of range tree t around lo. Returns the
+ *     new root, which is the range starting at lo if there is one, and
+ *     otherwise the range just below or just above lo.
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static range_t *splay_range(range_t *t, char *lo)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
+    range_t *l = NULL, *r = NULL;       /* roots of the left and right trees */
+    range_t *lmax = NULL, *rmin = NULL; /* where to hang the next ranges */
+    range_t *y;
+
+    if (t == NULL)
+	return NULL;
+
+    while (t->lo != lo) {
+	if (lo < t->lo) {
+	    if ((y = t->left) == NULL)
+		break;
+	    if (lo < y->lo) {                 /* rotate right */
+		t->left = y->right;
+		y->right = t;
+		t = y;
+		if (t->left == NULL)
+		    break;
+	    }
+	    if (rmin) rmin->left = t;         /* link right */
+	    else r = t;
+	    rmin = t;
+	    t = t->left;
+	}
+	else {
+	    if ((y = t->right) == NULL)
+		break;
+	    if (lo > y->lo) {                 /* rotate left */
+		t->right = y->left;
+		y->left = t;
+		t = y;
+		if (t->right == NULL)
+		    break;
+	    }
+	    if (lmax) lmax->right = t;        /* link left */
+	    else l = t;
+	    lmax = t;
+	    t = t->right;
 	}
-	op_index++;
-	
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
-}
 
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    /* Reassemble */
+    if (lmax) {
+	lmax->right = t->left;
+	t->left = l;
+    }
+    if (rmin) {
+	rmin->left = t->right;
+	t->right = r;
+    }
+    return t;
 }
 
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -589,7 +868,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -604,7 +883,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = mm->malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -633,7 +912,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -653,7 +932,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -671,7 +950,50 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm->free(p);
+	    break;
+
+        case BALLOC: /* mm_malloc_batch */
+	    if (!batch_malloc(size, trace->ops[i].count,
+			      &trace->blocks[index])) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+
+	    /* Check, fill and remember every block as for ALLOC */
+	    for (j = index; j < index + trace->ops[i].count; j++) {
+		p = trace->blocks[j];
+		if (add_range(ranges, p, size, tracenum, i) == 0)
+		    return 0;
+		memset(p, j & 0xFF, size);
+		trace->block_sizes[j] = size;
+	    }
+	    break;
+
+        case BFREE: /* mm_free_batch */
+	    for (j = index; j < index + trace->ops[i].count; j++)
+		remove_range(ranges, trace->blocks[j]);
+	    batch_free(&trace->blocks[index], trace->ops[i].count);
+	    break;
+
+        case MEMALIGN: /* mm_memalign */
+	    if ((p = mm->memalign(trace->ops[i].align, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_memalign failed.");
+		return 0;
+	    }
+	    if ((size_t)p % trace->ops[i].align != 0) {
+		sprintf(msg, "Payload address (%p) not aligned to %d bytes",
+			p, trace->ops[i].align);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+
+	    /* Check, fill and remember the block as for ALLOC */
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
 	    break;
 
 	default:
@@ -689,25 +1011,37 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   largest size of the heap in bytes while running the student's
+ *   malloc package on the trace. mem_sbrk() lets the students shrink
+ *   the heap, so we use the high water mark of the brk and not its
+ *   final value.
+ *
+ *   The heap pages resident in memory are sampled whenever the heap or
+ *   the mapped regions change size, since mincore over all of them is
+ *   too slow to run after every request, and every RSS_EVERY requests
+ *   for pages touched or released in between, and once more after the
+ *   last request: *rss_end is that final amount and *rss_peak the high
+ *   water mark of all the samples.
+ *   With -U, the heap is sampled into the timeline as well.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *rss_peak, double *rss_end)
 {   
-    int i;
-    int index;
+    int i, j;
+    int index, count;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    size_t rss, max_rss = 0;
+    size_t heap = 0, mapped = 0;
     char *p;
     char *newp, *oldp;
 
-    /* initialize the heap and the mm malloc package */
+    /* initialize the heap and the mm malloc package, with none of the
+       pages left resident by the previous runs */
     mem_reset_brk();
-    if (mm_init() < 0)
+    mem_release(mem_heap_lo(), MAX_HEAP);
+    if (mm->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -717,7 +1051,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm->malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -739,7 +1073,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -760,7 +1094,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -768,16 +1102,139 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case BALLOC: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    count = trace->ops[i].count;
+
+	    if (!batch_malloc(size, count, &trace->blocks[index]))
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = index; j < index + count; j++)
+		trace->block_sizes[j] = size;
+
+	    total_size += size * count;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case BFREE: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    count = trace->ops[i].count;
+	    for (j = index; j < index + count; j++)
+		total_size -= trace->block_sizes[j];
+
+	    batch_free(&trace->blocks[index], count);
+	    break;
+
+        case MEMALIGN: /* mm_memalign */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+
+	    if ((p = mm->memalign(trace->ops[i].align, size)) == NULL) 
+		app_error("mm_memalign failed in eval_mm_util");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	if (mem_heapsize() != heap || mem_mapsize() != mapped ||
+	    (i+1) % RSS_EVERY == 0) {
+	    heap = mem_heapsize();
+	    mapped = mem_mapsize();
+	    rss = mem_resident();
+	    max_rss = (rss > max_rss) ? rss : max_rss;
+	}
+	if (timeline != NULL && 
+	    ((i+1) % timeline_every == 0 || i == trace->num_ops - 1))
+	    sample_heap(tracenum, i, total_size);
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    /* The final sample, after the last request, counts for the peak */
+    *rss_end = mem_resident();
+    *rss_peak = (*rss_end > max_rss) ? *rss_end : max_rss;
+    return ((double)max_total_size / (double)mem_heap_peak());
 }
 
 
+/*
+ * open_timeline - Open the CSV file of the -U timeline and write the
+ *     names of its columns
+ */
+static void open_timeline(char *path)
+{
+    int i;
+
+    if ((timeline = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s for the timeline", path);
+	unix_error(msg);
+    }
+    fprintf(timeline, "package,trace,request,live,heap,mapped,util,"
+	    "free_blocks,free_bytes,largest_free,frag");
+    for (i = 0; i < FREE_CLASSES - 1; i++)
+	fprintf(timeline, (i < 6) ? ",le%d" : ",le%dK", 
+		(i < 6) ? 16 << i : 1 << (i - 6));
+    fprintf(timeline, ",more\n");
+}
+
+/*
+ * sample_heap - Write a line of the timeline for the heap as it is after
+ *     request opnum of a trace, with total_size payload bytes live: the
+ *     size of the heap and of the regions mapped outside it, the free
+ *     blocks and how they are spread over the size classes, and the
+ *     external fragmentation, which is the share of the free bytes
+ *     outside the largest free block. The free block columns are left
+ *     empty for a package that cannot walk its free blocks.
+ */
+static void sample_heap(int tracenum, int opnum, int total_size)
+{
+    size_t heap = mem_heapsize(), mapped = mem_mapsize();
+    int i;
+
+    fprintf(timeline, "%s,%d,%d,%d,%lu,%lu,%.4f", mm->name, tracenum, opnum,
+	    total_size, (unsigned long)heap, (unsigned long)mapped,
+	    heap + mapped ? (double)total_size / (heap + mapped) : 0.0);
+    if (mm->free_blocks == NULL) {
+	for (i = 0; i < 4 + FREE_CLASSES; i++)
+	    fputc(',', timeline);
+	fputc('\n', timeline);
+	return;
+    }
+
+    memset(&free_seen, 0, sizeof(free_seen));
+    mm->free_blocks(visit_free);
+    fprintf(timeline, ",%lu,%lu,%lu,%.4f", (unsigned long)free_seen.count,
+	    (unsigned long)free_seen.bytes, (unsigned long)free_seen.largest,
+	    free_seen.bytes ? 
+	    1.0 - (double)free_seen.largest / free_seen.bytes : 0.0);
+    for (i = 0; i < FREE_CLASSES; i++)
+	fprintf(timeline, ",%lu", (unsigned long)free_seen.sizes[i]);
+    fputc('\n', timeline);
+}
+
+/*
+ * visit_free - Tally a free block of the heap walk of sample_heap
+ */
+static void visit_free(size_t size)
+{
+    int class = 0;
+
+    while (class < FREE_CLASSES - 1 && size > (size_t)16 << class)
+	class++;
+    free_seen.count++;
+    free_seen.bytes += size;
+    if (size > free_seen.largest)
+	free_seen.largest = size;
+    free_seen.sizes[class]++;
+}
+
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
@@ -790,7 +1247,7 @@ static void eval_mm_speed(void *ptr)
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (mm->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -800,7 +1257,7 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm->malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -809,7 +1266,7 @@ static void eval_mm_speed(void *ptr)
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -817,7 +1274,27 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm->free(block);
+            break;
+
+        case BALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if (!batch_malloc(size, trace->ops[i].count, &trace->blocks[index]))
+		app_error("mm_malloc_batch error in eval_mm_speed");
+            break;
+
+        case BFREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            batch_free(&trace->blocks[index], trace->ops[i].count);
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm->memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
             break;
 
 	default:
@@ -825,6 +1302,582 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * batch_malloc - Allocate the n blocks of a batch request into ptrs,
+ *    with one call to mm_malloc_batch, or one mm_malloc per block
+ *    under -b. Return 1 if all of them were allocated.
+ */
+static int batch_malloc(int size, int n, char **ptrs)
+{
+    int i;
+
+    if (!split_batches)
+	return mm->malloc_batch(size, n, (void **)ptrs) == (size_t)n;
+    for (i = 0; i < n; i++)
+	if ((ptrs[i] = mm->malloc(size)) == NULL)
+	    return 0;
+    return 1;
+}
+
+/*
+ * batch_free - Free the n blocks of a batch request in ptrs, with one
+ *    call to mm_free_batch, or one mm_free per block under -b.
+ */
+static void batch_free(char **ptrs, int n)
+{
+    int i;
+
+    if (!split_batches) {
+	mm->free_batch((void **)ptrs, n);
+	return;
+    }
+    for (i = 0; i < n; i++)
+	mm->free(ptrs[i]);
+}
+
+/*
+ * eval_mm_latency - Run the trace through the mm package once to warm
+ *    it up, then again reading the cycle counter around every call, and
+ *    record the cycles each call took in the histogram of its type
+ */
+static void eval_mm_latency(trace_t *trace, hist_t *hists)
+{
+    int i, index, size;
+    char *p;
+    unsigned long long start;
+    speed_t speed_params;
+
+    speed_params.trace = trace;
+    eval_mm_speed(&speed_params);
+
+    mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+    for (i = 0; i < OPTYPES; i++)
+	hist_clear(&hists[i]);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	start = read_counter();
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            p = mm->malloc(size);
+            break;
+
+	case REALLOC: /* mm_realloc */
+            p = mm->realloc(trace->blocks[index], size);
+            break;
+
+        case FREE: /* mm_free */
+            mm->free(trace->blocks[index]);
+	    p = NULL;
+            break;
+
+        case BALLOC: /* mm_malloc_batch */
+            if (!batch_malloc(size, trace->ops[i].count, &trace->blocks[index]))
+		app_error("mm_malloc_batch error in eval_mm_latency");
+	    p = trace->blocks[index];
+            break;
+
+        case BFREE: /* mm_free_batch */
+            batch_free(&trace->blocks[index], trace->ops[i].count);
+	    p = NULL;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            p = mm->memalign(trace->ops[i].align, size);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+        }
+	hist_record(&hists[trace->ops[i].type], read_counter() - start);
+
+	if (trace->ops[i].type == ALLOC || trace->ops[i].type == REALLOC ||
+	    trace->ops[i].type == MEMALIGN) {
+	    if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+	    trace->blocks[index] = p;
+	}
+    }
+}
+
+/*
+ * replay_requests - Replay the allocations of a trace as a series of
+ *    requests, each of which allocates REQUEST_BYTES and then frees it
+ *    all. A realloc is replayed as the allocation of a new block and
+ *    frees are dropped. Blocks come from arena, which is reset at the
+ *    end of every request, or if it is NULL, from mm_malloc, with one
+ *    mm_free per block at the end of the request.
+ */
+static void replay_requests(trace_t *trace, char **objs, arena_t *arena)
+{
+    int i, j, count;
+    int n = 0;
+    size_t bytes = 0;
+    char *p;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	if (trace->ops[i].type == FREE || trace->ops[i].type == BFREE)
+	    continue;
+	count = (trace->ops[i].type == BALLOC) ? trace->ops[i].count : 1;
+	for (j = 0; j < count; j++) {
+	    p = arena ? arena_alloc(arena, trace->ops[i].size) :
+		mm->malloc(trace->ops[i].size);
+	    if (p == NULL)
+		app_error("allocation failed in replay_requests");
+	    if (!arena)
+		objs[n++] = p;
+	}
+
+	/* End of the request: free everything it allocated */
+	bytes += (size_t)trace->ops[i].size * count;
+	if (bytes >= REQUEST_BYTES || i == trace->num_ops - 1) {
+	    if (arena)
+		arena_reset(arena);
+	    for (j = 0; j < n; j++)
+		mm->free(objs[j]);
+	    n = 0;
+	    bytes = 0;
+	}
+    }
+    for (j = 0; j < n; j++)
+	mm->free(objs[j]);
+}
+
+/*
+ * eval_free_speed - Function timed by fcyc for the requests of a trace
+ *    torn down with one mm_free per block
+ */
+static void eval_free_speed(void *ptr)
+{
+    speed_t *params = (speed_t *)ptr;
+
+    mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_free_speed");
+    replay_requests(params->trace, params->objs, NULL);
+}
+
+/*
+ * eval_arena_speed - Function timed by fcyc for the requests of a trace
+ *    torn down with one arena_reset
+ */
+static void eval_arena_speed(void *ptr)
+{
+    speed_t *params = (speed_t *)ptr;
+    arena_t *arena;
+
+    mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_arena_speed");
+    if ((arena = arena_create(0)) == NULL)
+	app_error("arena_create failed in eval_arena_speed");
+    replay_requests(params->trace, params->objs, arena);
+    arena_destroy(arena);
+}
+
+/*
+ * count_allocs - Number of blocks the allocation requests of a trace
+ *    allocate
+ */
+static int count_allocs(trace_t *trace)
+{
+    int i, n = 0;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	if (trace->ops[i].type == BALLOC)
+	    n += trace->ops[i].count;
+	else if (trace->ops[i].type != FREE && trace->ops[i].type != BFREE)
+	    n++;
+    }
+    return n;
+}
+
+/*****************************************************************
+ * The following routines replay a trace from several threads at
+ * once, each thread with its own copy of the trace, against a
+ * package that is safe to call from several threads.
+ ****************************************************************/
+
+/*
+ * eval_threads - Replay each valid trace from 1, 2, 4, ... and finally
+ *     maxthreads threads, first with every thread freeing its own blocks
+ *     and then with every thread passing the blocks it frees to the next
+ *     thread. Print the throughput of each, how much it improved on one
+ *     thread, and that speedup per thread; the shortfall from 100% is
+ *     the cost of contention between the threads.
+ */
+static void eval_threads(char **tracefiles, int num_tracefiles, 
+			 stats_t *stats, int maxthreads)
+{
+    int i, n, row, rows, remote, failed;
+    trace_t *trace;
+    double ops[32], secs[32][2];             /* by row, i.e. log2 of threads */
+    double total_ops[32], total_secs[32][2]; /* ... over all the traces */
+    int threads[32];
+
+    for (n = 1, rows = 0; ; n = (2*n < maxthreads) ? 2*n : maxthreads) {
+	threads[rows++] = n;
+	if (n == maxthreads)
+	    break;
+    }
+    memset(total_ops, 0, sizeof(total_ops));
+    memset(total_secs, 0, sizeof(total_secs));
+
+    printf("Threaded replay of %s malloc on %ld CPUs:\n", mm->name,
+	   sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%13s   %-26s%s\n", "", "own frees", "remote frees");
+    printf("%5s%8s%9s%8s%6s%12s%8s%6s\n", "trace", "threads",
+	   "Kops", "speedup", "eff", "Kops", "speedup", "eff");
+
+    for (i=0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	failed = 0;
+	for (row = 0; row < rows; row++) {
+	    ops[row] = (double)threads[row] * trace->num_ops;
+	    for (remote = 0; remote < 2; remote++) {
+		secs[row][remote] = (row == 0 && remote) ? 0 :
+		    eval_threads_speed(trace, threads[row], remote);
+		failed |= secs[row][remote] == 0 && !(row == 0 && remote);
+	    }
+	}
+	sprintf(msg, "%2d", i);
+	printthreads(msg, rows, threads, ops, secs);
+	free_trace(trace);
+
+	/* Only the traces every run completed count towards the totals */
+	if (failed)
+	    continue;
+	for (row = 0; row < rows; row++) {
+	    total_ops[row] += ops[row];
+	    total_secs[row][0] += secs[row][0];
+	    total_secs[row][1] += secs[row][1];
+	}
+    }
+    if (total_ops[0] > 0)
+	printthreads("all", rows, threads, total_ops, total_secs);
+    printf("\n");
+}
+
+/*
+ * printthreads - Print the throughput of each run of the threaded replay
+ *     of a trace, and its speedup and efficiency over one thread, or "-"
+ *     for the runs that did not complete
+ */
+static void printthreads(char *label, int rows, int *threads, double *ops,
+			 double secs[][2])
+{
+    int row, remote;
+    double kops, base = 0;
+
+    for (row = 0; row < rows; row++) {
+	printf("%5s%8d", label, threads[row]);
+	for (remote = 0; remote < 2; remote++) {
+	    kops = (secs[row][remote] > 0) ? (ops[row]/1e3)/secs[row][remote] : 0;
+	    if (row == 0 && !remote)
+		base = kops;
+	    if (kops == 0 || base == 0)
+		printf("%9s%8s%6s", "-", "-", "-");
+	    else
+		printf("%9.0f%7.2fx%5.0f%%", kops, kops/base,
+		       100.0*kops/base/threads[row]);
+	    printf(remote ? "\n" : "   ");
+	}
+    }
+}
+
+/*
+ * eval_threads_speed - Return the fastest time in seconds, out of
+ *     THREAD_RUNS runs, for nthreads threads to each replay the trace,
+ *     or 0 if the package ran out of memory
+ */
+static double eval_threads_speed(trace_t *trace, int nthreads, int remote)
+{
+    thread_t *threads;
+    pthread_barrier_t start;
+    double t0 = 0, t1 = 0, secs, best = 0;
+    int i, run, failed = 0, nfrees = count_frees(trace);
+
+    if ((threads = (thread_t *)calloc(nthreads, sizeof(thread_t))) == NULL)
+	unix_error("threads calloc in eval_threads_speed failed");
+    for (i = 0; i < nthreads; i++) {
+	threads[i].trace = trace;
+	threads[i].next = &threads[remote ? (i + 1) % nthreads : i];
+	threads[i].prev = &threads[remote ? (i + nthreads - 1) % nthreads : i];
+	threads[i].start = &start;
+	threads[i].blocks = (char **)malloc(trace->num_ids * sizeof(char *));
+	threads[i].inbox = (char **)malloc(nfrees * sizeof(char *));
+	if (threads[i].blocks == NULL ||
+	    (threads[i].inbox == NULL && nfrees > 0))
+	    unix_error("blocks malloc in eval_threads_speed failed");
+    }
+
+    for (run = 0; run < THREAD_RUNS && !failed; run++) {
+	mem_reset_brk();
+	if (mm->init() < 0)
+	    app_error("mm_init failed in eval_threads_speed");
+	for (i = 0; i < nthreads; i++)
+	    threads[i].inbox_head = threads[i].inbox_tail = 
+		threads[i].done = threads[i].failed = 0;
+
+	pthread_barrier_init(&start, NULL, nthreads + 1);
+	for (i = 0; i < nthreads; i++)
+	    if (pthread_create(&threads[i].tid, NULL, replay_thread,
+			       &threads[i]) != 0)
+		unix_error("pthread_create in eval_threads_speed failed");
+	pthread_barrier_wait(&start);
+
+	/* Time from the first thread starting to the last one finishing */
+	for (i = 0; i < nthreads; i++) {
+	    pthread_join(threads[i].tid, NULL);
+	    failed |= threads[i].failed;
+	    secs = threads[i].t0.tv_sec + threads[i].t0.tv_nsec / 1e9;
+	    t0 = (i == 0 || secs < t0) ? secs : t0;
+	    secs = threads[i].t1.tv_sec + threads[i].t1.tv_nsec / 1e9;
+	    t1 = (i == 0 || secs > t1) ? secs : t1;
+	}
+	pthread_barrier_destroy(&start);
+
+	secs = t1 - t0;
+	if (run == 0 || secs < best)
+	    best = secs;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+	free(threads[i].blocks);
+	free(threads[i].inbox);
+    }
+    free(threads);
+    return failed ? 0 : best;
+}
+
+/*
+ * replay_thread - Replay the trace of a thread_t through the package,
+ *     freeing its blocks through thread->next, and then free the blocks
+ *     the previous thread passes to it until that thread is done too
+ */
+static void *replay_thread(void *ptr)
+{
+    thread_t *thread = (thread_t *)ptr;
+    trace_t *trace = thread->trace;
+    char **blocks = thread->blocks;
+    int i, j, index, count;
+    char *p;
+
+    pthread_barrier_wait(thread->start);
+    clock_gettime(CLOCK_MONOTONIC, &thread->t0);
+
+    for (i = 0;  i < trace->num_ops && !thread->failed;  i++) {
+	index = trace->ops[i].index;
+	count = trace->ops[i].count;
+	p = NULL;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            p = blocks[index] = mm->malloc(trace->ops[i].size);
+            break;
+
+	case REALLOC: /* mm_realloc */
+            p = blocks[index] = mm->realloc(blocks[index], trace->ops[i].size);
+            break;
+
+        case FREE: /* mm_free */
+	    pass_block(thread, blocks[index]);
+	    p = blocks[index];
+            break;
+
+        case BALLOC: /* mm_malloc_batch */
+            if (batch_malloc(trace->ops[i].size, count, &blocks[index]))
+		p = blocks[index];
+            break;
+
+        case BFREE: /* mm_free_batch */
+	    if (thread->next == thread)
+		batch_free(&blocks[index], count);
+	    else
+		for (j = 0; j < count; j++)
+		    pass_block(thread, blocks[index + j]);
+	    p = blocks[index];
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            p = blocks[index] = mm->memalign(trace->ops[i].align,
+					     trace->ops[i].size);
+            break;
+        }
+	if (p == NULL)
+	    thread->failed = 1;
+	drain_inbox(thread);
+    }
+
+    /* Keep freeing what the previous thread passes on until it is done */
+    __atomic_store_n(&thread->done, 1, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(&thread->prev->done, __ATOMIC_ACQUIRE) ||
+	   thread->inbox_head < __atomic_load_n(&thread->inbox_tail,
+						 __ATOMIC_ACQUIRE)) {
+	drain_inbox(thread);
+	sched_yield();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &thread->t1);
+    return NULL;
+}
+
+/*
+ * pass_block - Free block p of a thread, or under remote frees pass it
+ *     to the next thread, which frees it
+ */
+static void pass_block(thread_t *thread, char *p)
+{
+    thread_t *next = thread->next;
+
+    if (next == thread) {
+	mm->free(p);
+	return;
+    }
+    next->inbox[next->inbox_tail] = p;
+    __atomic_store_n(&next->inbox_tail, next->inbox_tail + 1, 
+		     __ATOMIC_RELEASE);
+}
+
+/*
+ * drain_inbox - Free the blocks passed to a thread since it last looked
+ */
+static void drain_inbox(thread_t *thread)
+{
+    int tail = __atomic_load_n(&thread->inbox_tail, __ATOMIC_ACQUIRE);
+
+    while (thread->inbox_head < tail)
+	mm->free(thread->inbox[thread->inbox_head++]);
+}
+
+/*
+ * count_frees - Return the number of blocks the trace frees
+ */
+static int count_frees(trace_t *trace)
+{
+    int i, n = 0;
+
+    for (i = 0; i < trace->num_ops; i++)
+	if (trace->ops[i].type == FREE)
+	    n++;
+	else if (trace->ops[i].type == BFREE)
+	    n += trace->ops[i].count;
+    return n;
+}
+
+/*****************************************************************
+ * The following routines count the hardware events, such as cache
+ * and TLB misses, of replaying a trace.
+ ****************************************************************/
+
+/*
+ * eval_events - Count the hardware events of replaying each valid trace,
+ *     in its fastest run of the K-best scheme, and print them per request
+ *     next to the throughput of the trace, with the instructions per
+ *     cycle. Events the machine cannot count are shown as "-".
+ */
+static void eval_events(char **tracefiles, int num_tracefiles, 
+			stats_t *stats)
+{
+    int i, j;
+    trace_t *trace;
+    speed_t speed_params;
+    double counts[PERF_EVENTS], total_counts[PERF_EVENTS];
+    double ops = 0, secs = 0;
+
+    for (j = 0; j < PERF_EVENTS; j++)
+	total_counts[j] = 0;
+
+    printf("Hardware events per request for %s malloc:\n", mm->name);
+    printf("%5s%9s%6s", "trace", "Kops", "IPC");
+    for (j = PERF_L1D_MISSES; j < PERF_EVENTS; j++)
+	printf("%10s", perf_names[j]);
+    printf("\n");
+
+    for (i=0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	speed_params.trace = trace;
+	fcyc_events(eval_mm_speed, &speed_params, counts);
+	sprintf(msg, "%2d", i);
+	printevents(msg, stats[i].ops, stats[i].secs, counts);
+	free_trace(trace);
+
+	ops += stats[i].ops;
+	secs += stats[i].secs;
+	for (j = 0; j < PERF_EVENTS; j++)
+	    if (total_counts[j] >= 0)
+		total_counts[j] = (counts[j] >= 0) ? 
+		    total_counts[j] + counts[j] : -1;
+    }
+    if (ops > 0)
+	printevents("all", ops, secs, total_counts);
+    printf("\n");
+}
+
+/*
+ * printevents - Print a line of the hardware event table: the throughput,
+ *     the instructions per cycle and the other events per request
+ */
+static void printevents(char *label, double ops, double secs, 
+			double *counts)
+{
+    int j;
+
+    printf("%5s%9.0f", label, (ops/1e3)/secs);
+    if (counts[PERF_CYCLES] > 0 && counts[PERF_INSTRUCTIONS] >= 0)
+	printf("%6.2f", counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES]);
+    else
+	printf("%6s", "-");
+    for (j = PERF_L1D_MISSES; j < PERF_EVENTS; j++) {
+	if (counts[j] >= 0)
+	    printf("%10.3f", counts[j] / ops);
+	else
+	    printf("%10s", "-");
+    }
+    printf("\n");
+}
+
+/*
+ * libc_init, libc_memalign, libc_malloc_batch, libc_free_batch - The
+ *     entry points of libc_ops that libc lacks
+ */
+static int libc_init(void)
+{
+    return 0;
+}
+
+static void *libc_memalign(size_t align, size_t size)
+{
+    void *p;
+
+    return posix_memalign(&p, align, size) == 0 ? p : NULL;
+}
+
+static size_t libc_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	if ((ptrs[i] = malloc(size)) == NULL)
+	    break;
+    return i;
+}
+
+static void libc_free_batch(void **ptrs, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	free(ptrs[i]);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -833,7 +1886,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -861,6 +1914,30 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+        case BALLOC: /* malloc for each block of the batch */
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + j] = p;
+	    }
+	    break;
+
+        case BFREE: /* free for each block of the batch */
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    if (posix_memalign((void **)&p, trace->ops[i].align,
+			       trace->ops[i].size) != 0) {
+		malloc_error(tracenum, i, "libc posix_memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -876,7 +1953,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -906,6 +1983,28 @@ static void eval_libc_speed(void *ptr)
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+        case BALLOC: /* malloc for each block of the batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		if ((trace->blocks[index + j] = malloc(size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+	    break;
+
+        case BFREE: /* free for each block of the batch */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[index + j]);
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    index = trace->ops[i].index;
+	    if (posix_memalign((void **)&p, trace->ops[i].align,
+			       trace->ops[i].size) != 0)
+		unix_error("posix_memalign failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
 	}
     }
 }
@@ -926,17 +2025,22 @@ static void printresults(int n, stats_t *stats)
     double util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%6s%8s%8s\n", 
+	   "trace", " valid", "util", "ops", "secs", "Kops", "rss-hi", "rss");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
+	    if (stats[i].rss_peak > 0)
+		printf("%7.0fK%7.0fK\n",
+		       stats[i].rss_peak/1024, stats[i].rss_end/1024);
+	    else
+		printf("%8s%8s\n", "-", "-");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
@@ -972,6 +2076,61 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printpackages - Prints the aggregate results of each malloc package,
+ *     and of libc malloc if libc_stats is not NULL, one row per package
+ */
+static void printpackages(summary_t *summary, int n,
+			  stats_t *libc_stats, int num_tracefiles)
+{
+    int i;
+    double secs = 0;
+    double ops = 0;
+
+    printf("\n%-8s %-31s %-26s %-26s%5s%7s%6s\n",
+	   "package", "lists", "fit", "realloc", "util", "Kops", "perf");
+    for (i=0; i < n; i++) {
+	if (summary[i].errors == 0)
+	    printf("%-8s %-31s %-26s %-26s%4.0f%%%7.0f%6.0f\n",
+		   packages[i]->name, packages[i]->lists, packages[i]->fit,
+		   packages[i]->resize, summary[i].util*100.0,
+		   summary[i].thru/1e3, summary[i].perfindex);
+	else
+	    printf("%-8s %-31s %-26s %-26s%5s%7s%6s\n",
+		   packages[i]->name, packages[i]->lists, packages[i]->fit,
+		   packages[i]->resize, "-", "-", "-");
+    }
+
+    if (libc_stats != NULL) {
+	for (i=0; i < num_tracefiles; i++) {
+	    secs += libc_stats[i].secs;
+	    ops += libc_stats[i].ops;
+	}
+	printf("%-8s %-31s %-26s %-26s%5s%7.0f%6s\n",
+	       "libc", "-", "-", "-", "-", (ops/1e3)/secs, "-");
+    }
+}
+
+/*
+ * printlatency - Print the count and latency percentiles of each type
+ *     of request that was timed, one row per type
+ */
+static void printlatency(char *label, hist_t *hists)
+{
+    int i;
+
+    for (i=0; i < OPTYPES; i++) {
+	if (hists[i].count == 0)
+	    continue;
+	printf("%5s %-13s%10lu%8llu%8llu%8llu%10llu\n",
+	       label, op_names[i], hists[i].count,
+	       hist_quantile(&hists[i], 0.5),
+	       hist_quantile(&hists[i], 0.99),
+	       hist_quantile(&hists[i], 0.999),
+	       hists[i].max);
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +2163,23 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValbrpHL] [-f <file>] [-t <dir>] [-T <n>]\n"
+	    "               [-U <csv> [-u <n>]]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-b         Run batch requests one block at a time.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Count cache, TLB and branch misses per request.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print latency percentiles of each request type.\n");
+    fprintf(stderr, "\t-p         Compare huge pages with base pages.\n");
+    fprintf(stderr, "\t-r         Compare arena reset with per-object free.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Replay the traces from up to <n> threads.\n");
+    fprintf(stderr, "\t-u <n>     Sample the heap every <n> requests for -U.\n");
+    fprintf(stderr, "\t-U <csv>   Write a timeline of the heap and its free blocks.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
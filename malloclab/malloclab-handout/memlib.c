@@ -3,6 +3,7 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE             /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,24 +15,88 @@
 #include "memlib.h"
 #include "config.h"
 
+/* Size and alignment of the huge pages the heap may be backed with */
+#define HUGE_PAGESIZE (1<<21)
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static size_t mem_peak;      /* high water mark of heap plus mapped bytes */
+static size_t mem_heap_len;  /* length of the mapping backing the heap */
+
+/* Regions mapped with mem_map, outside the heap */
+typedef struct region_t {
+    char *addr;              /* first byte of the region */
+    size_t len;              /* length of the region in bytes */
+    struct region_t *next;
+} region_t;
+
+static region_t *mem_regions;  /* list of mapped regions */
+static size_t mem_mapped;      /* total length of the mapped regions */
+
+static void mem_note_peak(void);
+static size_t mem_resident_range(char *addr, size_t len);
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
-	exit(1);
+    mem_init_pages(MEM_PAGES_BASE);
+}
+
+/*
+ * mem_init_pages - initialize the memory system model with a heap
+ *    backed by pages of the given kind: MEM_PAGES_BASE for base pages,
+ *    MEM_PAGES_THP for a mapping aligned to HUGE_PAGESIZE and advised
+ *    for transparent huge pages, MEM_PAGES_HUGETLB for huge pages from
+ *    the hugetlb pool, or transparent ones if the pool has too few.
+ *    Returns the kind of pages the heap got.
+ */
+int mem_init_pages(int pages)
+{
+    size_t align = (pages == MEM_PAGES_BASE) ? mem_pagesize() : HUGE_PAGESIZE;
+    size_t len = (MAX_HEAP + align - 1) & ~(align - 1);
+    char *addr = MAP_FAILED;
+    size_t lead;
+
+#ifdef MAP_HUGETLB
+    if (pages == MEM_PAGES_HUGETLB)
+	addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (addr == MAP_FAILED) {
+	if (pages == MEM_PAGES_HUGETLB)
+	    pages = MEM_PAGES_THP;
+
+	/* Map align bytes more and unmap what lies outside the aligned part */
+	addr = mmap(NULL, len + align, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+	    fprintf(stderr, "mem_init_vm: mmap error\n");
+	    exit(1);
+	}
+	lead = (align - (size_t)addr % align) % align;
+	if (lead)
+	    munmap(addr, lead);
+	munmap(addr + lead + len, align - lead);
+	addr += lead;
+
+#ifdef MADV_HUGEPAGE
+	if (pages == MEM_PAGES_THP && madvise(addr, len, MADV_HUGEPAGE) < 0)
+	    pages = MEM_PAGES_BASE;
+#else
+	pages = MEM_PAGES_BASE;
+#endif
     }
 
+    mem_start_brk = addr;
+    mem_heap_len = len;
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_peak = 0;
+    return pages;
 }
 
 /* 
@@ -39,21 +104,26 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_reset_brk();
+    munmap(mem_start_brk, mem_heap_len);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    and unmap the regions that are still mapped
  */
 void mem_reset_brk()
 {
+    while (mem_regions)
+	mem_unmap(mem_regions->addr, mem_regions->len);
     mem_brk = mem_start_brk;
+    mem_peak = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
  *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    this model, the heap cannot be shrunk by mem_sbrk: see mem_trim.
  */
 void *mem_sbrk(int incr) 
 {
@@ -65,9 +135,178 @@ void *mem_sbrk(int incr)
 	return (void *)-1;
     }
     mem_brk += incr;
+    mem_note_peak();
+    return (void *)old_brk;
+}
+
+/*
+ * mem_trim - shrink the heap by decr bytes and give their pages back.
+ *    Returns 0, or -1 if the heap is smaller than decr bytes.
+ */
+int mem_trim(size_t decr)
+{
+    if (decr > (size_t)(mem_brk - mem_start_brk)) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_trim failed. Heap cannot shrink that much...\n");
+	return -1;
+    }
+    mem_brk -= decr;
+    mem_release(mem_brk, decr);
+    return 0;
+}
+
+/*
+ * mem_grant - thread-safe variant of mem_sbrk for allocators that share
+ *    the heap between threads. Atomically moves the brk up by incr bytes
+ *    and returns the start address of the new area. Do not mix it with
+ *    mem_sbrk calls from other threads.
+ */
+void *mem_grant(size_t incr)
+{
+    char *old_brk = __atomic_load_n(&mem_brk, __ATOMIC_RELAXED);
+    size_t peak;
+
+    do {
+	if (incr > (size_t)(mem_max_addr - old_brk)) {
+	    errno = ENOMEM;
+	    fprintf(stderr, "ERROR: mem_grant failed. Ran out of memory...\n");
+	    return (void *)-1;
+	}
+    } while (!__atomic_compare_exchange_n(&mem_brk, &old_brk, old_brk + incr,
+					  1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    peak = __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
+    while (peak < (size_t)(old_brk + incr - mem_start_brk) &&
+	   !__atomic_compare_exchange_n(&mem_peak, &peak,
+					(size_t)(old_brk + incr - mem_start_brk),
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
     return (void *)old_brk;
 }
 
+/*
+ * mem_release - give the whole pages in the len bytes at addr back to
+ *    the system, like madvise(MADV_DONTNEED). They stay part of the heap
+ *    and read as zeros the next time they are touched.
+ */
+void mem_release(void *addr, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    size_t lo = ((size_t)addr + pagesize - 1) & ~(pagesize - 1);
+    size_t hi = ((size_t)addr + len) & ~(pagesize - 1);
+
+    if (lo < hi)
+	madvise((void *)lo, hi - lo, MADV_DONTNEED);
+}
+
+/*
+ * mem_map - model of an anonymous mmap. Maps a region of len bytes,
+ *    rounded up to whole pages, outside the heap and returns its start
+ *    address, or (void *)-1.
+ */
+void *mem_map(size_t len)
+{
+    region_t *r;
+    char *addr;
+
+    len = (len + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+	fprintf(stderr, "ERROR: mem_map failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    if ((r = (region_t *)malloc(sizeof(region_t))) == NULL) {
+	munmap(addr, len);
+	errno = ENOMEM;
+	return (void *)-1;
+    }
+    r->addr = addr;
+    r->len = len;
+    r->next = mem_regions;
+    mem_regions = r;
+    mem_mapped += len;
+    mem_note_peak();
+    return (void *)addr;
+}
+
+/*
+ * mem_unmap - unmap the region of len bytes at addr returned by mem_map
+ */
+void mem_unmap(void *addr, size_t len)
+{
+    region_t *r, **prevp;
+
+    for (prevp = &mem_regions; (r = *prevp) != NULL; prevp = &r->next) {
+	if (r->addr == addr) {
+	    assert(r->len == ((len + mem_pagesize() - 1) & ~(mem_pagesize() - 1)));
+	    munmap(r->addr, r->len);
+	    mem_mapped -= r->len;
+	    *prevp = r->next;
+	    free(r);
+	    return;
+	}
+    }
+    fprintf(stderr, "ERROR: mem_unmap of %p, which is not mapped\n", addr);
+}
+
+/*
+ * mem_remap - model of mremap. Resizes the region of oldlen bytes at addr
+ *    to newlen bytes, moving it if it cannot grow in place, and returns
+ *    its new address, or (void *)-1. The contents are kept without
+ *    copying.
+ */
+void *mem_remap(void *addr, size_t oldlen, size_t newlen)
+{
+    region_t *r;
+    char *newaddr;
+
+    newlen = (newlen + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    for (r = mem_regions; r != NULL && r->addr != addr; r = r->next)
+	;
+    if (r == NULL) {
+	fprintf(stderr, "ERROR: mem_remap of %p, which is not mapped\n", addr);
+	return (void *)-1;
+    }
+    assert(r->len == ((oldlen + mem_pagesize() - 1) & ~(mem_pagesize() - 1)));
+
+    newaddr = mremap(r->addr, r->len, newlen, MREMAP_MAYMOVE);
+    if (newaddr == MAP_FAILED) {
+	fprintf(stderr, "ERROR: mem_remap failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    mem_mapped += newlen - r->len;
+    r->addr = newaddr;
+    r->len = newlen;
+    mem_note_peak();
+    return (void *)newaddr;
+}
+
+/*
+ * mem_is_mapped - return true if bytes lo through hi lie in one region
+ *    returned by mem_map
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    region_t *r;
+
+    for (r = mem_regions; r != NULL; r = r->next)
+	if ((char *)lo >= r->addr && (char *)hi < r->addr + r->len)
+	    return 1;
+    return 0;
+}
+
+/*
+ * mem_note_peak - update the high water mark of the heap and mapped bytes
+ */
+static void mem_note_peak(void)
+{
+    size_t size = (size_t)(mem_brk - mem_start_brk) + mem_mapped;
+
+    if (size > mem_peak)
+	mem_peak = size;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -92,6 +331,62 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_mapsize() - returns the bytes of the regions mapped with mem_map
+ */
+size_t mem_mapsize() 
+{
+    return mem_mapped;
+}
+
+/*
+ * mem_heap_peak() - returns the largest number of bytes the heap and the
+ *    mapped regions have taken at once since the last mem_reset_brk
+ */
+size_t mem_heap_peak()
+{
+    return mem_peak;
+}
+
+/*
+ * mem_resident() - returns the bytes of heap and mapped pages that are
+ *    resident in memory, as reported by mincore
+ */
+size_t mem_resident()
+{
+    region_t *r;
+    size_t resident = 0;
+
+    if (mem_brk != mem_start_brk)
+	resident += mem_resident_range(mem_start_brk, mem_brk - mem_start_brk);
+    for (r = mem_regions; r != NULL; r = r->next)
+	resident += mem_resident_range(r->addr, r->len);
+    return resident;
+}
+
+/*
+ * mem_resident_range - returns the bytes of resident pages among the
+ *    pages that hold the len bytes at addr
+ */
+static size_t mem_resident_range(char *addr, size_t len)
+{
+    unsigned char vec[256];
+    size_t pagesize = mem_pagesize();
+    size_t lo = (size_t)addr & ~(pagesize - 1);
+    size_t npages = ((size_t)addr + len - lo + pagesize - 1) / pagesize;
+    size_t i, n, resident = 0;
+
+    for (; npages > 0; npages -= n, lo += n * pagesize) {
+	n = (npages < sizeof(vec)) ? npages : sizeof(vec);
+	if (mincore((void *)lo, n * pagesize, vec) < 0)
+	    return resident;
+	for (i = 0; i < n; i++)
+	    if (vec[i] & 1)
+		resident += pagesize;
+    }
+    return resident;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
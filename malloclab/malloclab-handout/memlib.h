@@ -1,11 +1,27 @@
 #include <unistd.h>
 
+/* Kinds of pages the heap can be backed with */
+#define MEM_PAGES_BASE    0
+#define MEM_PAGES_THP     1   /* transparent huge pages */
+#define MEM_PAGES_HUGETLB 2   /* huge pages from the hugetlb pool */
+
 void mem_init(void);               
+int mem_init_pages(int pages);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+int mem_trim(size_t decr);
+void *mem_grant(size_t incr);
+void mem_release(void *addr, size_t len);
+void *mem_map(size_t len);
+void mem_unmap(void *addr, size_t len);
+void *mem_remap(void *addr, size_t oldlen, size_t newlen);
+int mem_is_mapped(void *lo, void *hi);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_mapsize(void);
+size_t mem_heap_peak(void);
+size_t mem_resident(void);
 size_t mem_pagesize(void);
 
@@ -0,0 +1,614 @@
+/*
+ * mm-buddy.c - binary buddy system
+ *
+ * Every free block is 2^k bytes for an order k from MIN_ORDER to
+ * MAX_ORDER, at an offset from the heap base that is a multiple of its
+ * size, so the buddy it was split from, and merges with again once both
+ * are free, lies at its offset with bit k flipped. There is a free list
+ * for every order, and for every order a bitmap with one bit for each
+ * place a block of that order can start, set while a free block of that
+ * order starts there. One more bitmap tells which lists are non-empty.
+ * malloc splits the first free block big enough, found with one
+ * bit-scan, in halves down to the order it needs, and free merges the
+ * block with its buddy as long as the buddy's bit is set, so both do
+ * work bounded by the number of orders, and a free block is never
+ * next to a free buddy of its own size.
+ *
+ * With BUDDY_TRIM, the default, an allocated block is not rounded up
+ * to a power of two: the tail past the request is freed as the aligned
+ * blocks that tile it, and freeing the block frees each aligned piece
+ * of it. That gives up the buddy system's bound of a factor of two on
+ * internal fragmentation for a better one, at the price of up to two
+ * pieces per order on every free. Since such a block need not be
+ * aligned, when no free block is big enough malloc also tries to start
+ * it at one of the first RUN_TRIES free blocks of half its size, if the
+ * blocks after that one are free. Build with BUDDY_TRIM=0 for the plain
+ * buddy system.
+ *
+ * Every block, allocated or free, starts with a header word holding its
+ * size and allocated bit, padded to DSIZE, and the blocks tile the
+ * heap. Buddies are found by the bitmaps and not by the headers, since
+ * the buddy of a free block may lie inside an allocated block.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/*********************************************************
+ * NOTE TO STUDENTS: Before you do anything else, please
+ * provide your team information in the following struct.
+ ********************************************************/
+team_t team = {
+    /* Team name */
+    "ateam",
+    /* First member's full name */
+    "Harry Bovik",
+    /* First member's email address */
+    "bovik@cs.cmu.edu",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""
+};
+
+/* Basic constants and macros */
+#define WSIZE       4       /* Word and header size (bytes) */
+#define DSIZE       8       /* Double word size (bytes) */
+
+/* Block orders: from a header and two links up to 1 GB */
+#define MIN_ORDER   4
+#define MAX_ORDER   30
+#define CHUNK_ORDER 12      /* Extend heap by at least this order (bytes) */
+#define RUN_TRIES   8       /* Free blocks tried as start of an unaligned fit */
+
+/* Free the tail of allocated blocks past the request, unless 0 */
+#ifndef BUDDY_TRIM
+#define BUDDY_TRIM  1
+#endif
+
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Largest request: its block must fit in the heap and be of an order */
+#define MAX_SIZE  (MIN((size_t)MAX_HEAP, (size_t)1 << MAX_ORDER) - DSIZE)
+
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc)  ((size) | (alloc))
+
+/* Read and write a word at address p */
+#define GET(p)       (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (val))
+
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p)  (GET(p) & ~0x7)
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+/* Given block ptr bp, compute address of its header */
+#define HDRP(bp)     ((char *)(bp) - DSIZE)
+
+/* Blocks are named by their offset from the heap base: the block ptr of
+   the block at offset off, and the offset of the block at bp */
+#define BLKP(off)    (heap_base + (off) + DSIZE)
+#define BLKOFF(bp)   ((size_t)((char *)(bp) - DSIZE - heap_base))
+#if MAX_HEAP > 0xffffffffUL
+#error "Block offsets are 32 bits: MAX_HEAP must be under 4 GB"
+#endif
+
+/* Block size in bytes of a request of size bytes, rounded up to a
+   multiple of the smallest block */
+#define ADJUST(size) \
+  (((size) + DSIZE + (1 << MIN_ORDER) - 1) & ~(size_t)((1 << MIN_ORDER) - 1))
+
+/* Free list links are the 32-bit offsets of the previous and next free
+   blocks of the same order, or NIL */
+#define NIL               (~0U)
+#define GET_PREV(bp)      (*(unsigned int *)(bp))
+#define GET_NEXT(bp)      (*((unsigned int *)(bp) + 1))
+#define SET_PREV(bp, val) (*(unsigned int *)(bp) = (val))
+#define SET_NEXT(bp, val) (*((unsigned int *)(bp) + 1) = (val))
+
+/* Bit-scan helpers: index of lowest and highest set bit of a nonzero word */
+#define FFS(x)   (__builtin_ctz(x))
+#define FFSL(x)  (__builtin_ctzl(x))
+#define FLSL(x)  (8*(int)sizeof(long) - 1 - __builtin_clzl(x))
+
+/* The bitmap of order k has a bit for every multiple of 2^k in the heap,
+   and one past it for the buddy of the last block */
+#define LBITS       (8*sizeof(unsigned long))
+#define MAP_WORDS   ((MAX_HEAP >> (MIN_ORDER - 1)) / LBITS + MAX_ORDER + 1)
+#define MAP_WORD(k, off)  (maps[k][((off) >> (k)) / LBITS])
+#define MAP_BIT(k, off)   (1UL << (((off) >> (k)) % LBITS))
+#define IS_FREE(k, off)   ((MAP_WORD(k, off) & MAP_BIT(k, off)) != 0)
+
+/* Global variables */
+static char *heap_base = 0;  /* Start of the block at offset 0 */
+static size_t top;           /* Offset of the end of the heap */
+
+/* Free lists, their bitmaps, and the bitmap of the non-empty lists */
+static unsigned int lists[MAX_ORDER + 1];
+static unsigned long *maps[MAX_ORDER + 1];
+static unsigned long freemap[MAP_WORDS];
+static unsigned int nonempty;
+
+/* Function prototypes for internal helper routines */
+static int extend_heap(size_t size);
+static size_t take_tail(void);
+static int grow(size_t off, size_t size, size_t asize);
+static int order_of(size_t size);
+static void coalesce(size_t off, int k);
+static void free_range(size_t start, size_t end);
+
+static void insert_free_block(size_t off, int k);
+static void remove_free_block(size_t off, int k);
+
+static void printblock(size_t off);
+static void checkheap(int verbose);
+
+/*
+ * mm_check - check for correctness and print block list
+ */
+void mm_check() {
+  checkheap(1);
+}
+
+/*
+ * mm_init - initialize the malloc package.
+ */
+int mm_init(void)
+{
+  unsigned long *map = freemap;
+  int k;
+
+  /* Clear the lists, and the bitmaps as far as the last heap reached */
+  for (k = MIN_ORDER; k <= MAX_ORDER; k++) {
+    maps[k] = map;
+    memset(map, 0, ((top >> k) / LBITS + 1) * sizeof(*map));
+    map += (MAX_HEAP >> k) / LBITS + 1;
+    lists[k] = NIL;
+  }
+  nonempty = 0;
+  top = 0;
+
+  /* Pad the heap so that payloads, DSIZE past the blocks, are aligned
+     like the blocks to the smallest block size */
+  if ((heap_base = mem_sbrk(DSIZE)) == (void *)-1)
+    return -1;
+  heap_base += DSIZE;
+  return 0;
+}
+
+/*
+ * mm_malloc - Split the smallest free block that fits down to the order
+ *     of the request, or extend the heap
+ */
+void *mm_malloc(size_t size)
+{
+  size_t asize;        /* Adjusted block size */
+  size_t off, gap;
+  unsigned int fits, next;
+  int i, k, c;
+
+  if (heap_base == 0){
+    mm_init();
+  }
+
+  /* Ignore spurious requests, and ones too big for any block */
+  if (size == 0 || size > MAX_SIZE)
+    return NULL;
+
+  asize = ADJUST(size);
+  k = order_of(asize);
+  if (!BUDDY_TRIM)
+    asize = (size_t)1 << k;
+
+  if ((fits = nonempty & (~0U << k)) != 0) {
+    c = FFS(fits);
+    off = lists[c];
+    remove_free_block(off, c);
+  }
+  else if (BUDDY_TRIM) {
+    /* No fit. The block needs no alignment, so try to start it at one
+       of the first few free blocks of half its size, growing it over
+       the free blocks after that one */
+    off = (k > MIN_ORDER) ? lists[k - 1] : NIL;
+    for (i = 0; i < RUN_TRIES && off != NIL; i++, off = next) {
+      next = GET_NEXT(BLKP(off));
+      remove_free_block(off, k - 1);
+      if (grow(off, (size_t)1 << (k - 1), asize) == 0) {
+        PUT(HDRP(BLKP(off)), PACK(asize, 1));
+        return BLKP(off);
+      }
+      insert_free_block(off, k - 1);
+    }
+
+    /* Else start it at the free blocks that end the heap and extend the
+       heap by what they lack */
+    off = take_tail();
+    if (off + asize > top && extend_heap(off + asize - top) < 0) {
+      free_range(off, top);
+      return NULL;
+    }
+    free_range(off + asize, top);
+    PUT(HDRP(BLKP(off)), PACK(asize, 1));
+    return BLKP(off);
+  }
+  else {
+    /* No fit. Extend the heap to a multiple of the block size and by
+       one block, and free the gap */
+    c = (k > CHUNK_ORDER) ? k : CHUNK_ORDER;
+    gap = top;
+    off = (top + ((size_t)1 << c) - 1) & ~(((size_t)1 << c) - 1);
+    if (extend_heap(off + ((size_t)1 << c) - top) < 0)
+      return NULL;
+    free_range(gap, off);
+  }
+
+  /* Split off upper halves until the block is of order k, and free the
+     tail past the request */
+  while (c > k) {
+    c--;
+    insert_free_block(off + ((size_t)1 << c), c);
+  }
+  free_range(off + asize, off + ((size_t)1 << k));
+  PUT(HDRP(BLKP(off)), PACK(asize, 1));
+  return BLKP(off);
+}
+
+/*
+ * mm_free - Free every aligned piece of a block
+ */
+void mm_free(void *ptr)
+{
+  size_t off;
+
+  if (ptr == 0)
+    return;
+
+  if (heap_base == 0){
+    mm_init();
+  }
+
+  off = BLKOFF(ptr);
+  free_range(off, off + GET_SIZE(HDRP(ptr)));
+}
+
+/*
+ * mm_realloc - Shrink in place, or grow over the free blocks after the
+ *     block, otherwise fall back to malloc, copy and free
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+  void *newptr;
+  size_t asize;
+  size_t oldsize;
+  size_t off;
+
+  /* If size == 0 then this is just free, and we return NULL. */
+  if(size == 0) {
+    mm_free(ptr);
+    return 0;
+  }
+
+  /* If oldptr is NULL, then this is just malloc. */
+  if(ptr == NULL) {
+    return mm_malloc(size);
+  }
+
+  if (size > MAX_SIZE)
+    return NULL;
+  off = BLKOFF(ptr);
+  oldsize = GET_SIZE(HDRP(ptr));
+  asize = ADJUST(size);
+  if (!BUDDY_TRIM)
+    asize = (size_t)1 << order_of(asize);
+
+  if (asize <= oldsize) {
+    free_range(off + asize, off + oldsize);
+    PUT(HDRP(ptr), PACK(asize, 1));
+    return ptr;
+  }
+  if (grow(off, oldsize, asize) == 0) {
+    PUT(HDRP(ptr), PACK(asize, 1));
+    return ptr;
+  }
+
+  if ((newptr = mm_malloc(size)) == NULL)
+    return 0;
+  memcpy(newptr, ptr, oldsize - DSIZE);
+  mm_free(ptr);
+  return newptr;
+}
+
+/*
+ * mm_memalign - Allocate a block of size bytes whose payload is aligned
+ *     to align bytes, a power of two: allocate align bytes more and free
+ *     the space before the aligned payload, and with BUDDY_TRIM the
+ *     space after the request
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+  char *bp, *p;
+  size_t off, poff, csize, asize;
+
+  /* Reject bad alignments, and requests too big for any block once the
+     alignment slack is added */
+  if (size == 0 || (align & (align - 1)) != 0 ||
+      align > MAX_SIZE - 2*DSIZE || size > MAX_SIZE - 2*DSIZE - align)
+    return NULL;
+  if (align <= 2*DSIZE)
+    return mm_malloc(size);
+  if ((bp = mm_malloc(size + align + 2*DSIZE)) == NULL)
+    return NULL;
+
+  p = (char *)(((size_t)bp + 2*DSIZE + align - 1) & ~(align - 1));
+  off = BLKOFF(bp);
+  poff = BLKOFF(p);
+  csize = GET_SIZE(HDRP(bp));
+  asize = BUDDY_TRIM ? ADJUST(size) : off + csize - poff;
+  PUT(HDRP(p), PACK(asize, 1));
+  free_range(off, poff);
+  free_range(poff + asize, off + csize);
+  return p;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into ptrs, one at a
+ *     time. Return the number of blocks allocated.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+  size_t i;
+
+  for (i = 0; i < n && (ptrs[i] = mm_malloc(size)) != NULL; i++)
+    ;
+  return i;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, one at a time
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    mm_free(ptrs[i]);
+}
+
+/*
+ * mm_free_blocks - Call visit with the size of every free block
+ */
+void mm_free_blocks(void (*visit)(size_t size))
+{
+  size_t off;
+
+  if (heap_base == 0)
+    return;
+  for (off = 0; off < top; off += GET_SIZE(HDRP(BLKP(off))))
+    if (!GET_ALLOC(HDRP(BLKP(off))))
+      visit(GET_SIZE(HDRP(BLKP(off))));
+}
+
+/* Policies and entry points of the package, for the driver */
+mm_ops_t mm_ops = {
+#if BUDDY_TRIM
+  "mm-buddy", "buddy, per order", "best fit, tail trimmed",
+#else
+  "mm-buddy", "buddy, per order", "best fit, power of two",
+#endif
+  "grow into next blocks",
+  mm_init, mm_malloc, mm_free, mm_realloc, mm_memalign,
+  mm_malloc_batch, mm_free_batch, mm_free_blocks, 0 /* single thread */
+};
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * extend_heap - Extend heap by size bytes, which the caller makes into
+ *     blocks. Return 0 if all went well, and -1 otherwise.
+ */
+static int extend_heap(size_t size)
+{
+  if (size > INT_MAX || (long)mem_sbrk(size) == -1)
+    return -1;
+  top += size;
+  return 0;
+}
+
+/*
+ * take_tail - Take the free blocks that end the heap off their lists and
+ *     return the offset of the first of them, or top if there are none
+ */
+static size_t take_tail(void)
+{
+  size_t off = top;
+  int k = MIN_ORDER;
+
+  /* A free block of order k ends at off only if off is a multiple of 2^k */
+  while (off && k <= MAX_ORDER && k <= FFSL(off)) {
+    if (IS_FREE(k, off - ((size_t)1 << k))) {
+      off -= (size_t)1 << k;
+      remove_free_block(off, k);
+      k = MIN_ORDER;
+    }
+    else
+      k++;
+  }
+  return off;
+}
+
+/*
+ * grow - Grow the allocated block at off from size to asize bytes over
+ *     the free blocks after it and, at the end of the heap, over new
+ *     heap. Return 0 if it did, and -1 if an allocated block is in the way.
+ */
+static int grow(size_t off, size_t size, size_t asize)
+{
+  size_t end = off + asize;
+  size_t p, q;
+
+  /* A plain buddy block must stay aligned to its size */
+  if (!BUDDY_TRIM && off % asize)
+    return -1;
+
+  for (p = off + size; p < end && p < top; p += GET_SIZE(HDRP(BLKP(p))))
+    if (GET_ALLOC(HDRP(BLKP(p))))
+      return -1;
+  if (p < end && extend_heap(end - p) < 0)
+    return -1;
+
+  /* Take the free blocks, and free what lies past end of the last one */
+  for (q = off + size; q < p; q += GET_SIZE(HDRP(BLKP(q))))
+    remove_free_block(q, FFSL(GET_SIZE(HDRP(BLKP(q)))));
+  free_range(end, p);
+  return 0;
+}
+
+/*
+ * order_of - Return the order of the smallest block of at least size bytes
+ */
+static int order_of(size_t size)
+{
+  if (size <= (1 << MIN_ORDER))
+    return MIN_ORDER;
+  return FLSL(size - 1) + 1;
+}
+
+/*
+ * coalesce - Merge the free block of order k at off with its buddy for
+ *     as long as the buddy is free, and put the result on its list
+ */
+static void coalesce(size_t off, int k)
+{
+  size_t buddy;
+
+  for (; k < MAX_ORDER; k++) {
+    buddy = off ^ ((size_t)1 << k);
+    if (!IS_FREE(k, buddy))
+      break;
+    remove_free_block(buddy, k);
+    off &= ~((size_t)1 << k);
+  }
+  insert_free_block(off, k);
+}
+
+/*
+ * free_range - Free the bytes from start to end as the largest aligned
+ *     blocks that tile them
+ */
+static void free_range(size_t start, size_t end)
+{
+  int k;
+
+  while (start < end) {
+    k = FLSL(end - start);
+    if (start && FFSL(start) < k)
+      k = FFSL(start);
+    if (k > MAX_ORDER)
+      k = MAX_ORDER;
+    coalesce(start, k);
+    start += (size_t)1 << k;
+  }
+}
+
+/*
+ * Free list operating functions
+ */
+static void insert_free_block(size_t off, int k) {
+  char *bp = BLKP(off);
+
+  PUT(HDRP(bp), PACK(1U << k, 0));
+  SET_PREV(bp, NIL);
+  SET_NEXT(bp, lists[k]);
+  if (lists[k] != NIL) SET_PREV(BLKP(lists[k]), off);
+  lists[k] = off;
+
+  MAP_WORD(k, off) |= MAP_BIT(k, off);
+  nonempty |= 1U << k;
+}
+
+static void remove_free_block(size_t off, int k) {
+  char *bp = BLKP(off);
+  unsigned int prev = GET_PREV(bp);
+  unsigned int next = GET_NEXT(bp);
+
+  if (prev != NIL) SET_NEXT(BLKP(prev), next);
+  else lists[k] = next;
+  if (next != NIL) SET_PREV(BLKP(next), prev);
+
+  /* Clear the bitmap bits, and the list's once it runs empty */
+  MAP_WORD(k, off) &= ~MAP_BIT(k, off);
+  if (lists[k] == NIL)
+    nonempty &= ~(1U << k);
+}
+
+/*
+ * debug helper functions
+ */
+static void printblock(size_t off)
+{
+  char *bp = BLKP(off);
+
+  printf("%p: offset %ld header: [%ld:%c]\n", bp, (long int)off,
+         (long int)GET_SIZE(HDRP(bp)), (GET_ALLOC(HDRP(bp)) ? 'a' : 'f'));
+}
+
+/*
+ * checkheap - Check that the blocks tile the heap, that free blocks are
+ *     aligned buddies on their lists and bitmaps, and none is left unmerged
+ */
+void checkheap(int verbose)
+{
+  size_t off, size, nfree = 0, nlisted = 0;
+  unsigned int o;
+  int k;
+
+  if (verbose)
+    printf("Heap (%p):\n", heap_base);
+
+  for (off = 0; off < top; off += size) {
+    if (verbose)
+      printblock(off);
+    size = GET_SIZE(HDRP(BLKP(off)));
+    if (size == 0 || size % (1 << MIN_ORDER)) {
+      printf("Error: block at %ld has size %ld\n", (long)off, (long)size);
+      return;
+    }
+    if ((size_t)BLKP(off) % 8)
+      printf("Error: %p is not doubleword aligned\n", BLKP(off));
+    if (GET_ALLOC(HDRP(BLKP(off))))
+      continue;
+
+    nfree++;
+    k = FFSL(size);
+    if (size != ((size_t)1 << k) || off % size)
+      printf("Error: free block at %ld is not an aligned buddy\n", (long)off);
+    else if (!IS_FREE(k, off))
+      printf("Error: free block at %ld is not in the bitmap\n", (long)off);
+    else if (k < MAX_ORDER && IS_FREE(k, off ^ size))
+      printf("Error: free buddies at %ld not merged\n", (long)off);
+  }
+  if (off != top)
+    printf("Error: blocks end at %ld, past the heap\n", (long)off);
+
+  for (k = MIN_ORDER; k <= MAX_ORDER; k++) {
+    if (!(nonempty & (1U << k)) != (lists[k] == NIL))
+      printf("Error: list bitmap out of sync at %d\n", k);
+    for (o = lists[k]; o != NIL; o = GET_NEXT(BLKP(o))) {
+      nlisted++;
+      if (GET(HDRP(BLKP(o))) != (1U << k) || !IS_FREE(k, o))
+        printf("Error: block at %u on list %d is not a free block\n", o, k);
+    }
+  }
+  if (nlisted != nfree)
+    printf("Error: %ld free blocks but %ld on the lists\n",
+           (long)nfree, (long)nlisted);
+}
@@ -6,9 +6,11 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -33,6 +35,10 @@ team_t team = {
 #define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Largest request: its block must fit in the heap and in a header word */
+#define MAX_SIZE  (MIN((size_t)MAX_HEAP, (size_t)~0x7U) - 2*DSIZE)
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
@@ -106,8 +112,8 @@ void *mm_malloc(size_t size)
     mm_init();
   }
 
-  /* Ignore spurious requests */
-  if (size == 0)
+  /* Ignore spurious requests, and ones too big for any block */
+  if (size == 0 || size > MAX_SIZE)
     return NULL;
 
   /* Adjust block size to include overhead and alignment reqs. */
@@ -187,6 +193,81 @@ void *mm_realloc(void *ptr, size_t size)
   return newptr;
 }
 
+/*
+ * mm_memalign - Allocate a block of size bytes whose payload is aligned
+ *     to align bytes, a power of two: allocate align bytes more and free
+ *     the space before the aligned payload as a block of its own
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+  char *bp, *p;
+  size_t csize;
+
+  /* Reject bad alignments, and requests too big for any block once the
+     alignment slack is added */
+  if (size == 0 || (align & (align - 1)) != 0 ||
+      align > MAX_SIZE - 2*DSIZE || size > MAX_SIZE - 2*DSIZE - align)
+    return NULL;
+  if (align <= DSIZE)
+    return mm_malloc(size);
+  if ((bp = mm_malloc(size + align + 2*DSIZE)) == NULL)
+    return NULL;
+
+  p = (char *)(((size_t)bp + 2*DSIZE + align - 1) & ~(align - 1));
+  csize = GET_SIZE(HDRP(bp));
+  PUT(HDRP(p), PACK(csize - (p - bp), 1));
+  PUT(FTRP(p), PACK(csize - (p - bp), 1));
+  PUT(HDRP(bp), PACK(p - bp, 1));
+  PUT(FTRP(bp), PACK(p - bp, 1));
+  mm_free(bp);
+  return p;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into ptrs, one at a
+ *     time. Return the number of blocks allocated.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+  size_t i;
+
+  for (i = 0; i < n && (ptrs[i] = mm_malloc(size)) != NULL; i++)
+    ;
+  return i;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, one at a time
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    mm_free(ptrs[i]);
+}
+
+/*
+ * mm_free_blocks - Call visit with the size of every free block
+ */
+void mm_free_blocks(void (*visit)(size_t size))
+{
+  char *bp;
+
+  if (heap_listp == 0)
+    return;
+  for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+    if (!GET_ALLOC(HDRP(bp)))
+      visit(GET_SIZE(HDRP(bp)));
+}
+
+/* Policies and entry points of the package, for the driver */
+mm_ops_t mm_ops = {
+  "mm-imp", "implicit list", "first fit", "malloc, copy, free",
+  mm_init, mm_malloc, mm_free, mm_realloc, mm_memalign,
+  mm_malloc_batch, mm_free_batch, mm_free_blocks, 0 /* single thread */
+};
+
 /* 
  * The remaining routines are internal helper routines 
  */
@@ -201,7 +282,7 @@ static void *extend_heap(size_t words)
 
   /* Allocate an even number of words to maintain alignment */
   size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-  if ((long)(bp = mem_sbrk(size)) == -1)
+  if (size > INT_MAX || (long)(bp = mem_sbrk(size)) == -1)
     return NULL;
 
   /* Initialize free block header/footer and the epilogue header */
@@ -0,0 +1,799 @@
+/*
+ * mm-mt.c - thread-safe allocator with several arenas and per-thread caches
+ *
+ * The heap is shared by NARENAS arenas. Each arena has its own segregated
+ * free lists and its own lock, and grows by taking regions of whole
+ * chunks from memlib through mem_grant(), which any thread may call. A
+ * chunk map records the arena that owns every chunk, so the owner of a
+ * block is found in constant time.
+ *
+ * Threads are assigned to arenas round-robin the first time they call
+ * into the package. Small blocks a thread frees go into its private
+ * cache, still marked allocated, and its next mallocs of the same size
+ * are served from there without taking any lock. A block freed by a
+ * thread of another arena is pushed on the owner's remote-free stack
+ * with a compare-and-swap; the owner frees it properly the next time it
+ * holds its lock.
+ *
+ * Each region is a small heap of its own: alignment padding, prologue,
+ * boundary-tag blocks, epilogue. When the next grant of an arena starts
+ * right where its last region ended, the region is extended instead. The
+ * padding word of every region links it to the arena's previous region
+ * so the checker can walk them all.
+ *
+ * mm_init must be called while no other thread is using the package.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/*********************************************************
+ * NOTE TO STUDENTS: Before you do anything else, please
+ * provide your team information in the following struct.
+ ********************************************************/
+team_t team = {
+    /* Team name */
+    "ateam",
+    /* First member's full name */
+    "Harry Bovik",
+    /* First member's email address */
+    "bovik@cs.cmu.edu",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""
+};
+
+/* Basic constants and macros */
+#define WSIZE       4       /* Word and header/footer size (bytes) */
+#define DSIZE       8       /* Double word size (bytes) */
+#define CHUNK_SHIFT 14      /* Regions are made of 16KB chunks */
+#define CHUNKSIZE  (1<<CHUNK_SHIFT)
+#define MAX_CHUNKS (MAX_HEAP >> CHUNK_SHIFT)
+
+#ifndef NARENAS
+#define NARENAS     8       /* Number of arenas */
+#endif
+#ifndef NCLASSES
+#define NCLASSES    10      /* Free lists per arena: 16, 32, ..., 4096, more */
+#endif
+#if NCLASSES < 2 || NCLASSES > 32
+#error "NCLASSES must be between 2 and 32"
+#endif
+
+#define TCACHE_MAX   256    /* Largest block size kept in thread caches */
+#define TCACHE_BINS  (TCACHE_MAX / DSIZE + 1)
+#define TCACHE_COUNT 32     /* Most blocks held by one thread cache bin */
+
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Largest request: its block must fit in the heap and in a header word */
+#define MAX_SIZE  (MIN((size_t)MAX_HEAP, (size_t)~0x7U) - 2*DSIZE)
+
+/* Bit-scan helper: index of lowest set bit of a nonzero word */
+#define FFS(x)  (__builtin_ctz(x))
+
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc)  ((size) | (alloc))
+
+/* Read and write a word at address p */
+#define GET(p)       (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (val))
+
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p)  (GET(p) & ~0x7)
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+/* Given block ptr bp, compute address of its header and footer */
+#define HDRP(bp)       ((char *)(bp) - WSIZE)
+#define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* Given block ptr bp, compute address of next and previous blocks */
+#define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
+#define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+
+/* Free list links are stored as 32-bit offsets from the start of the heap,
+   so they take one word on 32- and 64-bit machines alike. Offset 0 is the
+   alignment padding word, which is never a block, and stands for NULL */
+#define PTR2OFF(p)  ((p) ? (unsigned int)((char *)(p) - heap_base) : 0)
+#define OFF2PTR(o)  ((o) ? (void *)(heap_base + (o)) : NULL)
+#if MAX_HEAP > 0xffffffffUL
+#error "Free list offsets are 32 bits: MAX_HEAP must be under 4 GB"
+#endif
+
+/* Given block ptr bp, compute/update address of next and previous free blocks
+   in the same list. Blocks in a thread cache or on a remote-free stack
+   use the next link only */
+#define GET_PREV(bp)      OFF2PTR(*(unsigned int *)(bp))
+#define GET_NEXT(bp)      OFF2PTR(*((unsigned int *)(bp) + 1))
+#define SET_PREV(bp, val) (*(unsigned int *)(bp) = PTR2OFF(val))
+#define SET_NEXT(bp, val) (*((unsigned int *)(bp) + 1) = PTR2OFF(val))
+
+/* Given prologue block ptr bp of a region, get/set the previous region */
+#define GET_REGION(bp)      OFF2PTR(GET((char *)(bp) - DSIZE))
+#define SET_REGION(bp, val) PUT((char *)(bp) - DSIZE, PTR2OFF(val))
+
+/* Arena owning the chunk that holds address p */
+#define OWNER(p)  (&arenas[chunk_owner[((char *)(p) - heap_base) >> CHUNK_SHIFT]])
+
+typedef struct {
+  pthread_mutex_t lock;    /* Protects all other fields but remote */
+  void *roots[NCLASSES];   /* Segregated free lists */
+  unsigned int nonempty;   /* Bit c set when roots[c] has blocks */
+  char *regions;           /* Prologue of the newest region, or NULL */
+  char *brk;               /* End of the newest region */
+  unsigned int remote;     /* Stack of blocks freed by other threads */
+} arena_t;
+
+typedef struct {
+  unsigned long gen;       /* Heap generation the bins belong to */
+  arena_t *arena;          /* Arena of this thread, NULL until assigned */
+  int count[TCACHE_BINS];  /* Number of blocks in each bin */
+  void *bins[TCACHE_BINS]; /* Cached free blocks, one bin per block size */
+} tcache_t;
+
+/* Global variables */
+static char *heap_base = 0;        /* First heap byte, base of link offsets */
+static unsigned long generation;   /* Bumped by every mm_init */
+static unsigned int next_arena;    /* Round-robin arena assignment */
+static arena_t arenas[NARENAS];
+static unsigned char chunk_owner[MAX_CHUNKS];
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;   /* Flushes a thread's cache at exit */
+static __thread tcache_t tcache;
+
+/* Function prototypes for internal helper routines */
+static void init_once_routine(void);
+static tcache_t *get_tcache(void);
+static void tcache_flush(void *arg);
+static void remote_push(arena_t *a, void *bp);
+static void remote_drain(arena_t *a);
+
+static void *extend_arena(arena_t *a, size_t asize);
+static void place(arena_t *a, void *bp, size_t asize);
+static void *find_fit(arena_t *a, size_t asize);
+static void free_block(arena_t *a, void *bp);
+static void *coalesce(arena_t *a, void *bp);
+static size_t adjust_size(size_t size);
+
+static void insert_free_block(arena_t *a, void *bp);
+static void remove_free_block(arena_t *a, void *bp);
+static int get_class(size_t asize);
+
+static void printblock(void *bp);
+static void checkblock(void *bp);
+static void checkheap(int verbose);
+
+/*
+ * mm_check - check for correctness and print block list
+ */
+void mm_check() {
+  checkheap(1);
+}
+
+/*
+ * mm_init - initialize the malloc package. Regions are granted lazily,
+ *     so the heap stays empty until the first malloc.
+ */
+int mm_init(void)
+{
+  int i, c;
+
+  pthread_once(&init_once, init_once_routine);
+
+  heap_base = mem_heap_lo();
+  for (i = 0; i < NARENAS; i++) {
+    for (c = 0; c < NCLASSES; c++)
+      arenas[i].roots[c] = 0;
+    arenas[i].nonempty = 0;
+    arenas[i].regions = 0;
+    arenas[i].brk = 0;
+    arenas[i].remote = 0;
+  }
+  memset(chunk_owner, 0, sizeof(chunk_owner));
+
+  /* Invalidates every thread cache, whose blocks are gone now */
+  generation++;
+  return 0;
+}
+
+/*
+ * mm_malloc - Serve small requests from the thread cache, and everything
+ *     else from the thread's arena under its lock.
+ */
+void *mm_malloc(size_t size)
+{
+  size_t asize;      /* Adjusted block size */
+  tcache_t *tc;
+  arena_t *a;
+  char *bp;
+
+  /* Ignore spurious requests, and ones too big for any block */
+  if (size == 0 || size > MAX_SIZE)
+    return NULL;
+
+  asize = adjust_size(size);
+  tc = get_tcache();
+
+  /* Lock-free fast path */
+  if (asize <= TCACHE_MAX && (bp = tc->bins[asize / DSIZE]) != NULL) {
+    tc->bins[asize / DSIZE] = GET_NEXT(bp);
+    tc->count[asize / DSIZE]--;
+    return bp;
+  }
+
+  a = tc->arena;
+  pthread_mutex_lock(&a->lock);
+  remote_drain(a);
+  if ((bp = find_fit(a, asize)) == NULL)
+    bp = extend_arena(a, asize);
+  if (bp != NULL)
+    place(a, bp, asize);
+  pthread_mutex_unlock(&a->lock);
+
+  return bp;
+}
+
+/*
+ * mm_free - Free a block into the thread cache, the thread's own arena,
+ *     or the remote-free stack of the arena that owns it
+ */
+void mm_free(void *ptr)
+{
+  size_t size;
+  tcache_t *tc;
+  arena_t *a;
+
+  if (ptr == 0)
+    return;
+
+  size = GET_SIZE(HDRP(ptr));
+  tc = get_tcache();
+  a = OWNER(ptr);
+
+  if (a != tc->arena) {
+    remote_push(a, ptr);
+    return;
+  }
+
+  if (size <= TCACHE_MAX && tc->count[size / DSIZE] < TCACHE_COUNT) {
+    SET_NEXT(ptr, tc->bins[size / DSIZE]);
+    tc->bins[size / DSIZE] = ptr;
+    tc->count[size / DSIZE]++;
+    return;
+  }
+
+  pthread_mutex_lock(&a->lock);
+  remote_drain(a);
+  free_block(a, ptr);
+  pthread_mutex_unlock(&a->lock);
+}
+
+/*
+ * mm_realloc - Keep the block if it is big enough or can grow into a
+ *     free next block, giving back what it does not need of that block,
+ *     otherwise fall back to malloc, copy and free
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+  void *newptr;
+  void *next;
+  size_t asize;
+  size_t oldsize;
+  arena_t *a;
+
+  /* If size == 0 then this is just free, and we return NULL. */
+  if(size == 0) {
+    mm_free(ptr);
+    return 0;
+  }
+
+  /* If oldptr is NULL, then this is just malloc. */
+  if(ptr == NULL) {
+    return mm_malloc(size);
+  }
+
+  if (size > MAX_SIZE)
+    return NULL;
+  oldsize = GET_SIZE(HDRP(ptr));
+  asize = adjust_size(size);
+  if (asize <= oldsize)
+    return ptr;
+
+  a = OWNER(ptr);
+  pthread_mutex_lock(&a->lock);
+  remote_drain(a);
+  next = NEXT_BLKP(ptr);
+  if (!GET_ALLOC(HDRP(next)) && (oldsize + GET_SIZE(HDRP(next))) >= asize) {
+    oldsize += GET_SIZE(HDRP(next));
+    remove_free_block(a, next);
+    if (oldsize - asize >= 2*DSIZE) {
+      PUT(HDRP(ptr), PACK(asize, 1));
+      PUT(FTRP(ptr), PACK(asize, 1));
+      next = NEXT_BLKP(ptr);
+      PUT(HDRP(next), PACK(oldsize - asize, 0));
+      PUT(FTRP(next), PACK(oldsize - asize, 0));
+      insert_free_block(a, next);
+    }
+    else {
+      PUT(HDRP(ptr), PACK(oldsize, 1));
+      PUT(FTRP(ptr), PACK(oldsize, 1));
+    }
+    pthread_mutex_unlock(&a->lock);
+    return ptr;
+  }
+  pthread_mutex_unlock(&a->lock);
+
+  if ((newptr = mm_malloc(size)) == NULL)
+    return 0;
+  memcpy(newptr, ptr, oldsize - DSIZE);
+  mm_free(ptr);
+  return newptr;
+}
+
+/*
+ * mm_memalign - Allocate a block of size bytes whose payload is aligned
+ *     to align bytes, a power of two: allocate align bytes more and free
+ *     the space before the aligned payload and after the request as
+ *     blocks of their own
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+  char *bp, *p;
+  size_t csize, asize;
+  arena_t *a;
+
+  /* Reject bad alignments, and requests too big for any block once the
+     alignment slack is added */
+  if (size == 0 || (align & (align - 1)) != 0 ||
+      align > MAX_SIZE - 2*DSIZE || size > MAX_SIZE - 2*DSIZE - align)
+    return NULL;
+  if (align <= DSIZE)
+    return mm_malloc(size);
+  if ((bp = mm_malloc(size + align + 2*DSIZE)) == NULL)
+    return NULL;
+
+  p = (char *)(((size_t)bp + 2*DSIZE + align - 1) & ~(align - 1));
+  csize = GET_SIZE(HDRP(bp)) - (p - bp);
+
+  /* The request keeps a block of the size mm_malloc would give it */
+  asize = adjust_size(size);
+  if (csize - asize < 2*DSIZE)
+    asize = csize;
+  PUT(HDRP(p), PACK(asize, 1));
+  PUT(FTRP(p), PACK(asize, 1));
+  PUT(HDRP(bp), PACK(p - bp, 1));
+  PUT(FTRP(bp), PACK(p - bp, 1));
+  if (asize < csize) {
+    PUT(HDRP(NEXT_BLKP(p)), PACK(csize - asize, 1));
+    PUT(FTRP(NEXT_BLKP(p)), PACK(csize - asize, 1));
+  }
+
+  /* The slack goes straight back to the arena: in the thread cache it
+     would only serve requests of its odd size */
+  a = OWNER(bp);
+  pthread_mutex_lock(&a->lock);
+  free_block(a, bp);
+  if (asize < csize)
+    free_block(a, NEXT_BLKP(p));
+  pthread_mutex_unlock(&a->lock);
+  return p;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into ptrs, one at a
+ *     time. Return the number of blocks allocated.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+  size_t i;
+
+  for (i = 0; i < n && (ptrs[i] = mm_malloc(size)) != NULL; i++)
+    ;
+  return i;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, one at a time
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    mm_free(ptrs[i]);
+}
+
+/*
+ * mm_free_blocks - Call visit with the size of every free block in the
+ *     regions of every arena and in the thread cache of the caller,
+ *     which are still marked allocated. Blocks on the remote-free
+ *     stacks count as allocated until their owner frees them. Only
+ *     call this while no other thread is using the package.
+ */
+void mm_free_blocks(void (*visit)(size_t size))
+{
+  char *region, *bp;
+  int i;
+
+  for (i = 0; i < NARENAS; i++)
+    for (region = arenas[i].regions; region; region = GET_REGION(region))
+      for (bp = region; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        if (!GET_ALLOC(HDRP(bp)))
+          visit(GET_SIZE(HDRP(bp)));
+
+  if (tcache.gen != generation)
+    return;
+  for (i = 0; i < TCACHE_BINS; i++)
+    for (bp = tcache.bins[i]; bp; bp = GET_NEXT(bp))
+      visit(i * DSIZE);
+}
+
+/* Policies and entry points of the package, for the driver */
+mm_ops_t mm_ops = {
+  "mm-mt", "segregated per arena", "first fit", "grow into next block",
+  mm_init, mm_malloc, mm_free, mm_realloc, mm_memalign,
+  mm_malloc_batch, mm_free_batch, mm_free_blocks, 1 /* thread-safe */
+};
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * init_once_routine - One-time setup of the locks and the thread-exit hook
+ */
+static void init_once_routine(void)
+{
+  int i;
+
+  for (i = 0; i < NARENAS; i++)
+    pthread_mutex_init(&arenas[i].lock, NULL);
+  pthread_key_create(&tcache_key, tcache_flush);
+}
+
+/*
+ * get_tcache - Return the calling thread's cache, assigning the thread
+ *     an arena on first use and emptying the cache if mm_init ran since
+ */
+static tcache_t *get_tcache(void)
+{
+  tcache_t *tc = &tcache;
+
+  if (tc->gen != generation) {
+    if (tc->arena == NULL) {
+      tc->arena = &arenas[__atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED)
+                          % NARENAS];
+      pthread_setspecific(tcache_key, tc);
+    }
+    memset(tc->count, 0, sizeof(tc->count));
+    memset(tc->bins, 0, sizeof(tc->bins));
+    tc->gen = generation;
+  }
+  return tc;
+}
+
+/*
+ * tcache_flush - Give the blocks of an exiting thread's cache back to
+ *     its arena
+ */
+static void tcache_flush(void *arg)
+{
+  tcache_t *tc = arg;
+  arena_t *a = tc->arena;
+  void *bp;
+  int i;
+
+  if (tc->gen != generation)
+    return;
+
+  pthread_mutex_lock(&a->lock);
+  for (i = 0; i < TCACHE_BINS; i++) {
+    while ((bp = tc->bins[i]) != NULL) {
+      tc->bins[i] = GET_NEXT(bp);
+      free_block(a, bp);
+    }
+    tc->count[i] = 0;
+  }
+  pthread_mutex_unlock(&a->lock);
+}
+
+/*
+ * remote_push - Lock-free push of block bp on the remote-free stack of a
+ */
+static void remote_push(arena_t *a, void *bp)
+{
+  unsigned int head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+  do {
+    *((unsigned int *)bp + 1) = head;
+  } while (!__atomic_compare_exchange_n(&a->remote, &head, PTR2OFF(bp), 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * remote_drain - Free every block on the remote-free stack of a. Taking
+ *     the whole stack with one exchange avoids the ABA problem.
+ */
+static void remote_drain(arena_t *a)
+{
+  void *bp, *next;
+  unsigned int head;
+
+  if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == 0)
+    return;
+
+  head = __atomic_exchange_n(&a->remote, 0, __ATOMIC_ACQUIRE);
+  bp = OFF2PTR(head);
+  while (bp) {
+    next = GET_NEXT(bp);
+    free_block(a, bp);
+    bp = next;
+  }
+}
+
+/*
+ * extend_arena - Grant a region big enough for an asize block to arena a
+ *     and return the free block it adds
+ */
+static void *extend_arena(arena_t *a, size_t asize)
+{
+  char *p, *bp;
+  size_t size, i;
+
+  /* Leave room for padding, prologue and epilogue of a new region */
+  size = (asize + 4*WSIZE + CHUNKSIZE - 1) & ~(size_t)(CHUNKSIZE - 1);
+  if ((long)(p = mem_grant(size)) == -1)
+    return NULL;
+
+  for (i = 0; i < size; i += CHUNKSIZE)
+    chunk_owner[(p + i - heap_base) >> CHUNK_SHIFT] = a - arenas;
+
+  if (p == a->brk) {
+    /* Contiguous with our last region: extend it like extend_heap */
+    bp = p;
+    PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
+    PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+    a->brk = p + size;
+    return coalesce(a, bp);
+  }
+
+  /* Start a new region */
+  bp = p + (2*WSIZE);
+  PUT(bp - (1*WSIZE), PACK(DSIZE, 1));    /* Prologue header */
+  PUT(bp, PACK(DSIZE, 1));                /* Prologue footer */
+  SET_REGION(bp, a->regions);             /* Padding links the regions */
+  a->regions = bp;
+  a->brk = p + size;
+
+  bp += DSIZE;
+  size -= 4*WSIZE;
+  PUT(HDRP(bp), PACK(size, 0));           /* Free block header */
+  PUT(FTRP(bp), PACK(size, 0));           /* Free block footer */
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));   /* Epilogue header */
+  insert_free_block(a, bp);
+  return bp;
+}
+
+/*
+ * place - Place block of asize bytes at start of free block bp
+ *         and split if remainder would be at least minimum block size
+ */
+static void place(arena_t *a, void *bp, size_t asize)
+{
+  size_t csize = GET_SIZE(HDRP(bp));
+  remove_free_block(a, bp);
+
+  if ((csize - asize) >= (2*DSIZE)) {
+    PUT(HDRP(bp), PACK(asize, 1));
+    PUT(FTRP(bp), PACK(asize, 1));
+    bp = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(csize-asize, 0));
+    PUT(FTRP(bp), PACK(csize-asize, 0));
+    insert_free_block(a, bp);
+  }
+  else {
+    PUT(HDRP(bp), PACK(csize, 1));
+    PUT(FTRP(bp), PACK(csize, 1));
+  }
+}
+
+/*
+ * find_fit - Find a fit for a block with asize bytes in arena a
+ */
+static void *find_fit(arena_t *a, size_t asize)
+{
+  unsigned int lists;
+  void *bp;
+
+  // first fit search of the lists that have blocks, from the class of
+  // asize up; only there and in the last are there blocks too small
+  lists = a->nonempty & (~0u << get_class(asize));
+  for (; lists; lists &= lists - 1) {
+    for (bp = a->roots[FFS(lists)]; bp; bp = GET_NEXT(bp))
+      if (asize <= GET_SIZE(HDRP(bp))) return bp;
+  }
+
+  return NULL; /* No fit */
+}
+
+/*
+ * free_block - Mark block bp free and coalesce it
+ */
+static void free_block(arena_t *a, void *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+
+  PUT(HDRP(bp), PACK(size, 0));
+  PUT(FTRP(bp), PACK(size, 0));
+  coalesce(a, bp);
+}
+
+/*
+ * coalesce - Boundary tag coalescing. Return ptr to coalesced block
+ */
+static void *coalesce(arena_t *a, void *bp)
+{
+  size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+  size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+  size_t size = GET_SIZE(HDRP(bp));
+
+  if (prev_alloc && next_alloc) {            /* Case 1 */
+    insert_free_block(a, bp);
+    return bp;
+  }
+
+  else if (prev_alloc && !next_alloc) {      /* Case 2 */
+    remove_free_block(a, NEXT_BLKP(bp));
+
+    size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size,0));
+  }
+
+  else if (!prev_alloc && next_alloc) {      /* Case 3 */
+    remove_free_block(a, PREV_BLKP(bp));
+
+    size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+    PUT(FTRP(bp), PACK(size, 0));
+    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+    bp = PREV_BLKP(bp);
+  }
+
+  else {                                     /* Case 4 */
+    remove_free_block(a, NEXT_BLKP(bp));
+    remove_free_block(a, PREV_BLKP(bp));
+
+    size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
+      GET_SIZE(FTRP(NEXT_BLKP(bp)));
+    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+    PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+    bp = PREV_BLKP(bp);
+  }
+
+  insert_free_block(a, bp);
+  return bp;
+}
+
+/*
+ * adjust_size - Block size for a size-byte payload
+ */
+static size_t adjust_size(size_t size)
+{
+  if (size <= DSIZE)
+    return 2*DSIZE;
+  return DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+}
+
+/*
+ * Free list operating functions
+ */
+static void insert_free_block(arena_t *a, void *bp) {
+  int c = get_class(GET_SIZE(HDRP(bp)));
+
+  if (a->roots[c]) SET_PREV(a->roots[c], bp);
+  SET_PREV(bp, NULL);
+  SET_NEXT(bp, a->roots[c]);
+  a->roots[c] = bp;
+  a->nonempty |= 1u << c;
+}
+
+static void remove_free_block(arena_t *a, void *bp) {
+  int c = get_class(GET_SIZE(HDRP(bp)));
+  void *prev = GET_PREV(bp);
+  void *next = GET_NEXT(bp);
+
+  if (prev) SET_NEXT(prev, next);
+  else a->roots[c] = next;
+  if (next) SET_PREV(next, prev);
+  if (a->roots[c] == NULL)
+    a->nonempty &= ~(1u << c);
+}
+
+/*
+ * get_class - Free list for blocks of asize bytes: 16, 32, ..., more,
+ *     found with one bit-scan of asize - 1
+ */
+static int get_class(size_t asize) {
+  int c = 8*sizeof(long) - 4 - __builtin_clzl((asize - 1) | 15);
+
+  return (c < NCLASSES - 1) ? c : NCLASSES - 1;
+}
+
+/*
+ * debug helper functions
+ */
+static void printblock(void *bp)
+{
+  size_t hsize, halloc, fsize, falloc;
+
+  hsize = GET_SIZE(HDRP(bp));
+  halloc = GET_ALLOC(HDRP(bp));
+  fsize = GET_SIZE(FTRP(bp));
+  falloc = GET_ALLOC(FTRP(bp));
+
+  if (hsize == 0) {
+    printf("%p: EOL\n", bp);
+    return;
+  }
+
+  printf("%p: header: [%ld:%c] footer: [%ld:%c]\n", bp,
+         (long int)hsize, (halloc ? 'a' : 'f'),
+         (long int)fsize, (falloc ? 'a' : 'f'));
+}
+
+static void checkblock(void *bp)
+{
+  if ((size_t)bp % 8)
+    printf("Error: %p is not doubleword aligned\n", bp);
+  if (GET(HDRP(bp)) != GET(FTRP(bp)))
+    printf("Error: header does not match footer\n");
+}
+
+/*
+ * checkheap - Minimal check of every region of every arena. Only call
+ *     this while no other thread is using the package.
+ */
+void checkheap(int verbose)
+{
+  char *region, *bp;
+  int i, c;
+
+  for (i = 0; i < NARENAS; i++) {
+    for (region = arenas[i].regions; region; region = GET_REGION(region)) {
+      if (verbose)
+        printf("Arena %d region (%p):\n", i, region);
+
+      if ((GET_SIZE(HDRP(region)) != DSIZE) || !GET_ALLOC(HDRP(region)))
+        printf("Bad prologue header\n");
+      checkblock(region);
+
+      for (bp = region; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (verbose)
+          printblock(bp);
+        checkblock(bp);
+        if (OWNER(bp) != &arenas[i])
+          printf("Error: %p is in a chunk of another arena\n", bp);
+      }
+
+      if (verbose)
+        printblock(bp);
+      if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+        printf("Bad epilogue header\n");
+    }
+
+    for (c = 0; c < NCLASSES; c++)
+      if (!(arenas[i].nonempty & (1u << c)) != !arenas[i].roots[c])
+        printf("Error: arena %d class bitmap out of sync at %d\n", i, c);
+  }
+}
@@ -6,9 +6,11 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -33,6 +35,10 @@ team_t team = {
 #define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Largest request: its block must fit in the heap and in a header word */
+#define MAX_SIZE  (MIN((size_t)MAX_HEAP, (size_t)~0x7U) - 2*DSIZE)
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
@@ -53,27 +59,53 @@ team_t team = {
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* Free list links are stored as 32-bit offsets from the start of the heap,
+   so they take one word on 32- and 64-bit machines alike. Offset 0 is the
+   alignment padding word, which is never a block, and stands for NULL */
+#define PTR2OFF(p)  ((p) ? (unsigned int)((char *)(p) - heap_base) : 0)
+#define OFF2PTR(o)  ((o) ? (void *)(heap_base + (o)) : NULL)
+#if MAX_HEAP > 0xffffffffUL
+#error "Free list offsets are 32 bits: MAX_HEAP must be under 4 GB"
+#endif
+
 /* Given block ptr bp, compute/update address of next and previous free blocks
    in the same list */
-#define GET_PREV(bp)      (void *)(*(unsigned int *)(bp))
-#define GET_NEXT(bp)      (void *)(*((unsigned int *)(bp) + 1))
-#define SET_PREV(bp, val) (*(unsigned int *)(bp) = (unsigned int)(val))
-#define SET_NEXT(bp, val) (*((unsigned int *)(bp) + 1) = (unsigned int)(val))
+#define GET_PREV(bp)      OFF2PTR(*(unsigned int *)(bp))
+#define GET_NEXT(bp)      OFF2PTR(*((unsigned int *)(bp) + 1))
+#define SET_PREV(bp, val) (*(unsigned int *)(bp) = PTR2OFF(val))
+#define SET_NEXT(bp, val) (*((unsigned int *)(bp) + 1) = PTR2OFF(val))
+
+/* Free blocks go in NCLASSES classes by size: lists of blocks up to 16,
+   32, ..., TREE_MIN bytes, then a class for all larger blocks. A bitmap
+   has a bit set for every class that is not empty */
+#ifndef NCLASSES
+#define NCLASSES   10       /* Lists up to 4096 bytes, then the tree */
+#endif
+#if NCLASSES < 2 || NCLASSES > 32
+#error "NCLASSES must be between 2 and 32"
+#endif
+#define TREE_CLASS (NCLASSES - 1)
+#define TREE_MIN   ((size_t)16 << (NCLASSES - 2))
+
+/* Bit-scan helper: index of lowest set bit of a nonzero word */
+#define FFS(x)  (__builtin_ctz(x))
+
+/* Free blocks larger than TREE_MIN bytes are not kept in a list but in a
+   splay tree ordered by (size, address). Given block ptr bp, compute/update
+   its left and right children, which reuse the prev/next words */
+#define GET_LEFT(bp)       GET_PREV(bp)
+#define GET_RIGHT(bp)      GET_NEXT(bp)
+#define SET_LEFT(bp, val)  SET_PREV(bp, val)
+#define SET_RIGHT(bp, val) SET_NEXT(bp, val)
 
 /* Global variables */
 static char *heap_listp = 0;  /* Pointer to first block */
+static char *heap_base = 0;   /* First heap byte, base of link offsets */
 
-/* Pointers to free block lists */
-static void *root_16;
-static void *root_32;
-static void *root_64;
-static void *root_128;
-static void *root_256;
-static void *root_512;
-static void *root_1024;
-static void *root_2048;
-static void *root_4096;
-static void *root_etc;
+/* Free block lists by class, and the root of the splay tree of larger
+   blocks in the last; bit c of nonempty is set when class c has blocks */
+static void *roots[NCLASSES];
+static unsigned int nonempty;
 
 /* Function prototypes for internal helper routines */
 static void *extend_heap(size_t words);
@@ -85,8 +117,13 @@ static void *coalesce(void *bp);
 static void init_free_root();
 static void insert_free_block(void *bp);
 static void remove_free_block(void *bp);
-static void **get_free_rootp(size_t asize);
-static void **get_greater_rootp(void **rootp);
+static int get_class(size_t asize);
+
+static int tree_cmp(size_t size, void *addr, void *bp);
+static void *splay(void *t, size_t size, void *addr);
+static void tree_insert(void *bp);
+static void tree_remove(void *bp);
+static void *tree_best_fit(size_t asize);
 
 static void printblock(void *bp);
 static void checkblock(void *bp);
@@ -104,6 +141,7 @@ void mm_check() {
  */
 int mm_init(void)
 {
+  heap_base = mem_heap_lo();
   init_free_root();
 
   /* Create the initial empty heap */
@@ -135,8 +173,8 @@ void *mm_malloc(size_t size)
     mm_init();
   }
 
-  /* Ignore spurious requests */
-  if (size == 0)
+  /* Ignore spurious requests, and ones too big for any block */
+  if (size == 0 || size > MAX_SIZE)
     return NULL;
 
   /* Adjust block size to include overhead and alignment reqs. */
@@ -232,6 +270,8 @@ void *mm_realloc(void *ptr, size_t size)
   if(ptr == NULL) {
     return mm_malloc(size);
   }
+  if (size > MAX_SIZE)
+    return NULL;
 
   if (size <= DSIZE)
     asize = 2*DSIZE;
@@ -259,6 +299,81 @@ void *mm_realloc(void *ptr, size_t size)
     }
 }
 
+/*
+ * mm_memalign - Allocate a block of size bytes whose payload is aligned
+ *     to align bytes, a power of two: allocate align bytes more and free
+ *     the space before the aligned payload as a block of its own
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+  char *bp, *p;
+  size_t csize;
+
+  /* Reject bad alignments, and requests too big for any block once the
+     alignment slack is added */
+  if (size == 0 || (align & (align - 1)) != 0 ||
+      align > MAX_SIZE - 2*DSIZE || size > MAX_SIZE - 2*DSIZE - align)
+    return NULL;
+  if (align <= DSIZE)
+    return mm_malloc(size);
+  if ((bp = mm_malloc(size + align + 2*DSIZE)) == NULL)
+    return NULL;
+
+  p = (char *)(((size_t)bp + 2*DSIZE + align - 1) & ~(align - 1));
+  csize = GET_SIZE(HDRP(bp));
+  PUT(HDRP(p), PACK(csize - (p - bp), 1));
+  PUT(FTRP(p), PACK(csize - (p - bp), 1));
+  PUT(HDRP(bp), PACK(p - bp, 1));
+  PUT(FTRP(bp), PACK(p - bp, 1));
+  mm_free(bp);
+  return p;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into ptrs, one at a
+ *     time. Return the number of blocks allocated.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+  size_t i;
+
+  for (i = 0; i < n && (ptrs[i] = mm_malloc(size)) != NULL; i++)
+    ;
+  return i;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, one at a time
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    mm_free(ptrs[i]);
+}
+
+/*
+ * mm_free_blocks - Call visit with the size of every free block
+ */
+void mm_free_blocks(void (*visit)(size_t size))
+{
+  char *bp;
+
+  if (heap_listp == 0)
+    return;
+  for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+    if (!GET_ALLOC(HDRP(bp)))
+      visit(GET_SIZE(HDRP(bp)));
+}
+
+/* Policies and entry points of the package, for the driver */
+mm_ops_t mm_ops = {
+  "mm-seg", "segregated + splay tree", "first fit, best fit > 4KB", "grow into next block",
+  mm_init, mm_malloc, mm_free, mm_realloc, mm_memalign,
+  mm_malloc_batch, mm_free_batch, mm_free_blocks, 0 /* single thread */
+};
+
 /* 
  * The remaining routines are internal helper routines 
  */
@@ -273,7 +388,7 @@ static void *extend_heap(size_t words)
 
   /* Allocate an even number of words to maintain alignment */
   size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-  if ((long)(bp = mem_sbrk(size)) == -1)
+  if (size > INT_MAX || (long)(bp = mem_sbrk(size)) == -1)
     return NULL;
 
   /* Initialize free block header/footer and the epilogue header */
@@ -330,21 +445,24 @@ static void replace(void *bp, size_t asize) {
  */
 static void *find_fit(size_t asize)
 {
-  void **rootp;
+  int c = get_class(asize);
+  unsigned int larger;
   void *bp;
 
-  rootp = get_free_rootp(asize);
-  while (rootp) {
-    // first fit search
-    bp = *rootp;
-    while (bp) {
-      if (asize <= GET_SIZE(HDRP(bp))) return bp;
-      bp = GET_NEXT(bp);
-    }
-    rootp = get_greater_rootp(rootp);
-  }
+  // best fit search among the large blocks
+  if (c == TREE_CLASS)
+    return tree_best_fit(asize);
 
-  return NULL; /* No fit */
+  // first fit search in the class of asize, whose blocks may be smaller
+  for (bp = roots[c]; bp; bp = GET_NEXT(bp))
+    if (asize <= GET_SIZE(HDRP(bp)))
+      return bp;
+
+  // every block of a larger class fits: take the first of the next one
+  if ((larger = nonempty & (~0u << c << 1)) == 0)
+    return NULL; /* No fit */
+  c = FFS(larger);
+  return (c == TREE_CLASS) ? tree_best_fit(asize) : roots[c];
 }
 
 /*
@@ -401,61 +519,176 @@ static void *coalesce(void *bp)
  * Free list/tree operating functions
  */
 static void init_free_root() {
-  root_16 = 0;
-  root_32 = 0;
-  root_64 = 0;
-  root_128 = 0;
-  root_256 = 0;
-  root_512 = 0;
-  root_1024 = 0;
-  root_2048 = 0;
-  root_4096 = 0;
-  root_etc = 0;
+  int c;
+
+  for (c = 0; c < NCLASSES; c++)
+    roots[c] = 0;
+  nonempty = 0;
 }
 
 static void insert_free_block(void *bp) {
-  void **rootp = get_free_rootp(GET_SIZE(HDRP(bp)));
+  int c = get_class(GET_SIZE(HDRP(bp)));
+
+  nonempty |= 1u << c;
+  if (c == TREE_CLASS) {
+    tree_insert(bp);
+    return;
+  }
 
-  if (*rootp) SET_PREV(*rootp, bp);
+  if (roots[c]) SET_PREV(roots[c], bp);
   SET_PREV(bp, NULL);
-  SET_NEXT(bp, *rootp);
-  *rootp = bp;
+  SET_NEXT(bp, roots[c]);
+  roots[c] = bp;
 }
 
 static void remove_free_block(void *bp) {
-  void **rootp = get_free_rootp(GET_SIZE(HDRP(bp)));
+  int c = get_class(GET_SIZE(HDRP(bp)));
   void *prev = GET_PREV(bp);
   void *next = GET_NEXT(bp);
 
-  if (prev) SET_NEXT(prev, next);
-  else *rootp = next;
-  if (next) SET_PREV(next, prev);
+  if (c == TREE_CLASS)
+    tree_remove(bp);
+  else {
+    if (prev) SET_NEXT(prev, next);
+    else roots[c] = next;
+    if (next) SET_PREV(next, prev);
+  }
+  if (roots[c] == NULL)
+    nonempty &= ~(1u << c);
 }
 
-static void **get_free_rootp(size_t asize) {
-  if (asize <= 16) return &root_16;
-  else if (asize <= 32) return &root_32;
-  else if (asize <= 64) return &root_64;
-  else if (asize <= 128) return &root_128;
-  else if (asize <= 256) return &root_256;
-  else if (asize <= 512) return &root_512;
-  else if (asize <= 1024) return &root_1024;
-  else if (asize <= 2048) return &root_2048;
-  else if (asize <= 4096) return &root_4096;
-  else return &root_etc;
+/*
+ * get_class - Class of blocks of asize bytes: c for sizes up to 16 << c,
+ *     found with one bit-scan of asize - 1, and the tree above TREE_MIN
+ */
+static int get_class(size_t asize) {
+  int c = 8*sizeof(long) - 4 - __builtin_clzl((asize - 1) | 15);
+
+  return (c < TREE_CLASS) ? c : TREE_CLASS;
 }
 
-static void **get_greater_rootp(void **rootp) {
-  if (rootp == &root_16) return &root_32;
-  else if (rootp == &root_32) return &root_64;
-  else if (rootp == &root_64) return &root_128;
-  else if (rootp == &root_128) return &root_256;
-  else if (rootp == &root_256) return &root_512;
-  else if (rootp == &root_512) return &root_1024;
-  else if (rootp == &root_1024) return &root_2048;
-  else if (rootp == &root_2048) return &root_4096;
-  else if (rootp == &root_4096) return &root_etc;
-  else return NULL;
+/*
+ * tree_cmp - Compare key (size, addr) with the key of free block bp
+ */
+static int tree_cmp(size_t size, void *addr, void *bp) {
+  size_t bsize = GET_SIZE(HDRP(bp));
+
+  if (size != bsize) return (size < bsize) ? -1 : 1;
+  if (addr != bp) return ((char *)addr < (char *)bp) ? -1 : 1;
+  return 0;
+}
+
+/*
+ * splay - Top-down splay of tree t around key (size, addr). Returns the
+ *     new root, which is the node with that key if there is one, and
+ *     otherwise its predecessor or successor.
+ */
+static void *splay(void *t, size_t size, void *addr) {
+  void *l = NULL, *r = NULL;        /* Roots of the left and right trees */
+  void *lmax = NULL, *rmin = NULL;  /* Where to hang the next nodes */
+  void *y;
+  int c;
+
+  if (t == NULL)
+    return NULL;
+
+  while ((c = tree_cmp(size, addr, t)) != 0) {
+    if (c < 0) {
+      if ((y = GET_LEFT(t)) == NULL)
+        break;
+      if (tree_cmp(size, addr, y) < 0) {   /* rotate right */
+        SET_LEFT(t, GET_RIGHT(y));
+        SET_RIGHT(y, t);
+        t = y;
+        if (GET_LEFT(t) == NULL)
+          break;
+      }
+      if (rmin) SET_LEFT(rmin, t);         /* link right */
+      else r = t;
+      rmin = t;
+      t = GET_LEFT(t);
+    } else {
+      if ((y = GET_RIGHT(t)) == NULL)
+        break;
+      if (tree_cmp(size, addr, y) > 0) {   /* rotate left */
+        SET_RIGHT(t, GET_LEFT(y));
+        SET_LEFT(y, t);
+        t = y;
+        if (GET_RIGHT(t) == NULL)
+          break;
+      }
+      if (lmax) SET_RIGHT(lmax, t);        /* link left */
+      else l = t;
+      lmax = t;
+      t = GET_RIGHT(t);
+    }
+  }
+
+  /* Reassemble */
+  if (lmax) {
+    SET_RIGHT(lmax, GET_LEFT(t));
+    SET_LEFT(t, l);
+  }
+  if (rmin) {
+    SET_LEFT(rmin, GET_RIGHT(t));
+    SET_RIGHT(t, r);
+  }
+  return t;
+}
+
+static void tree_insert(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  void *t = splay(roots[TREE_CLASS], size, bp);
+
+  if (t == NULL) {
+    SET_LEFT(bp, NULL);
+    SET_RIGHT(bp, NULL);
+  } else if (tree_cmp(size, bp, t) < 0) {
+    SET_LEFT(bp, GET_LEFT(t));
+    SET_RIGHT(bp, t);
+    SET_LEFT(t, NULL);
+  } else {
+    SET_RIGHT(bp, GET_RIGHT(t));
+    SET_LEFT(bp, t);
+    SET_RIGHT(t, NULL);
+  }
+  roots[TREE_CLASS] = bp;
+}
+
+static void tree_remove(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  void *t = splay(roots[TREE_CLASS], size, bp);
+  void *x;
+
+  assert(t == bp);
+  if (GET_LEFT(t) == NULL) {
+    roots[TREE_CLASS] = GET_RIGHT(t);
+  } else {
+    /* All keys on the left are smaller, so this brings up its maximum */
+    x = splay(GET_LEFT(t), size, bp);
+    SET_RIGHT(x, GET_RIGHT(t));
+    roots[TREE_CLASS] = x;
+  }
+}
+
+/*
+ * tree_best_fit - Return the smallest (lowest addressed on ties) large
+ *     free block of at least asize bytes, or NULL
+ */
+static void *tree_best_fit(size_t asize) {
+  void *t;
+
+  if ((t = roots[TREE_CLASS] = splay(roots[TREE_CLASS], asize, NULL)) == NULL)
+    return NULL;
+  if (GET_SIZE(HDRP(t)) >= asize)
+    return t;
+
+  /* The root is the predecessor: its successor is the right minimum */
+  if ((t = GET_RIGHT(t)) == NULL)
+    return NULL;
+  while (GET_LEFT(t))
+    t = GET_LEFT(t);
+  return t;
 }
 
 /*
@@ -495,6 +728,7 @@ static void checkblock(void *bp)
 void checkheap(int verbose) 
 {
   char *bp = heap_listp;
+  int c;
 
   if (verbose)
     printf("Heap (%p):\n", heap_listp);
@@ -513,4 +747,8 @@ void checkheap(int verbose)
     printblock(bp);
   if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
     printf("Bad epilogue header\n");
+
+  for (c = 0; c < NCLASSES; c++)
+    if (!(nonempty & (1u << c)) != !roots[c])
+      printf("Error: class bitmap out of sync at %d\n", c);
 }
@@ -0,0 +1,645 @@
+/*
+ * mm-tlsf.c - two-level segregated fit (TLSF) free lists
+ *
+ * Free blocks are kept in FL_INDEX_COUNT x SL_INDEX_COUNT doubly linked
+ * lists. The first level splits sizes by powers of two, the second
+ * level splits every power-of-two range into SL_INDEX_COUNT equal
+ * classes. Two bitmaps record which lists are non-empty, so both the
+ * list for a free block and the first non-empty list that is big enough
+ * for a request are found with a couple of bit-scan instructions. Every
+ * malloc and free therefore does a bounded amount of work, no matter
+ * how many free blocks the heap holds.
+ *
+ * Blocks use the same header/footer boundary tags as the other mm
+ * variants, so coalescing is constant time too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/*********************************************************
+ * NOTE TO STUDENTS: Before you do anything else, please
+ * provide your team information in the following struct.
+ ********************************************************/
+team_t team = {
+    /* Team name */
+    "ateam",
+    /* First member's full name */
+    "Harry Bovik",
+    /* First member's email address */
+    "bovik@cs.cmu.edu",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""
+};
+
+/* Basic constants and macros */
+#define WSIZE       4       /* Word and header/footer size (bytes) */
+#define DSIZE       8       /* Double word size (bytes) */
+#define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */
+
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Largest request: its block must fit in the heap and in a header word */
+#define MAX_SIZE  (MIN((size_t)MAX_HEAP, (size_t)~0x7U) - 2*DSIZE)
+
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc)  ((size) | (alloc))
+
+/* Read and write a word at address p */
+#define GET(p)       (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (val))
+
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p)  (GET(p) & ~0x7)
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+/* Given block ptr bp, compute address of its header and footer */
+#define HDRP(bp)       ((char *)(bp) - WSIZE)
+#define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* Given block ptr bp, compute address of next and previous blocks */
+#define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
+#define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+
+/* Free list links are stored as 32-bit offsets from the start of the heap,
+   so they take one word on 32- and 64-bit machines alike. Offset 0 is the
+   alignment padding word, which is never a block, and stands for NULL */
+#define PTR2OFF(p)  ((p) ? (unsigned int)((char *)(p) - heap_base) : 0)
+#define OFF2PTR(o)  ((o) ? (void *)(heap_base + (o)) : NULL)
+#if MAX_HEAP > 0xffffffffUL
+#error "Free list offsets are 32 bits: MAX_HEAP must be under 4 GB"
+#endif
+
+/* Given block ptr bp, compute/update address of next and previous free blocks
+   in the same list */
+#define GET_PREV(bp)      OFF2PTR(*(unsigned int *)(bp))
+#define GET_NEXT(bp)      OFF2PTR(*((unsigned int *)(bp) + 1))
+#define SET_PREV(bp, val) (*(unsigned int *)(bp) = PTR2OFF(val))
+#define SET_NEXT(bp, val) (*((unsigned int *)(bp) + 1) = PTR2OFF(val))
+
+/* TLSF geometry */
+#define SL_INDEX_COUNT_LOG2  4   /* log2 of second-level lists per first level */
+#define ALIGN_SIZE_LOG2      3   /* log2 of DSIZE */
+#define FL_INDEX_MAX         32  /* FLS of the largest block, < 2^32 bytes, plus 1 */
+
+#define SL_INDEX_COUNT   (1 << SL_INDEX_COUNT_LOG2)
+#define FL_INDEX_SHIFT   (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_COUNT   (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE (1 << FL_INDEX_SHIFT)  /* sizes below this use fl 0 */
+
+/* Bit-scan helpers: index of lowest set bit of a nonzero word, and of
+   highest set bit of a nonzero size, which rounding can take past 2^32 */
+#define FFS(x)  (__builtin_ctz(x))
+#define FLS(x)  (63 - __builtin_clzll(x))
+
+/* Global variables */
+static char *heap_listp = 0;  /* Pointer to first block */
+static char *heap_base = 0;   /* First heap byte, base of link offsets */
+
+/* Free block lists and the bitmaps telling which of them are non-empty */
+static unsigned int fl_bitmap;
+static unsigned int sl_bitmap[FL_INDEX_COUNT];
+static void *blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+/* Function prototypes for internal helper routines */
+static void *extend_heap(size_t words);
+static void place(void *bp, size_t asize);
+static void replace(void *bp, size_t asize);
+static void *find_fit(size_t asize);
+static void *coalesce(void *bp);
+
+static void init_free_lists();
+static void insert_free_block(void *bp);
+static void remove_free_block(void *bp);
+static void mapping_insert(size_t size, int *fli, int *sli);
+static void mapping_search(size_t size, int *fli, int *sli);
+static void *search_suitable_block(int *fli, int *sli);
+
+static void printblock(void *bp);
+static void checkblock(void *bp);
+static void checkheap(int verbose);
+
+/*
+ * mm_check - check for correctness and print block list
+ */
+void mm_check() {
+  checkheap(1);
+}
+
+/*
+ * mm_init - initialize the malloc package.
+ */
+int mm_init(void)
+{
+  heap_base = mem_heap_lo();
+  init_free_lists();
+
+  /* Create the initial empty heap */
+  if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1)
+    return -1;
+  PUT(heap_listp, 0);                          /* Alignment padding */
+  PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */
+  PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
+  PUT(heap_listp + (3*WSIZE), PACK(0, 1));     /* Epilogue header */
+  heap_listp += (2*WSIZE);
+
+  /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+  if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
+    return -1;
+  return 0;
+}
+
+/*
+ * mm_malloc - Allocate a block from the first non-empty list whose
+ *     blocks are all at least asize bytes.
+ */
+void *mm_malloc(size_t size)
+{
+  size_t asize;      /* Adjusted block size */
+  size_t extendsize; /* Amount to extend heap if no fit */
+  char *bp;
+
+  if (heap_listp == 0){
+    mm_init();
+  }
+
+  /* Ignore spurious requests, and ones too big for any block */
+  if (size == 0 || size > MAX_SIZE)
+    return NULL;
+
+  /* Adjust block size to include overhead and alignment reqs. */
+  if (size <= DSIZE)
+    asize = 2*DSIZE;
+  else
+    asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+
+  /* Search the free lists for a fit */
+  if ((bp = find_fit(asize)) != NULL) {
+    place(bp, asize);
+    return bp;
+  }
+
+  /* No fit found. Get more memory and place the block */
+  extendsize = MAX(asize,CHUNKSIZE);
+  if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+    return NULL;
+  place(bp, asize);
+
+  return bp;
+}
+
+/*
+ * mm_free - Free a block
+ */
+void mm_free(void *ptr)
+{
+  if (ptr == 0)
+    return;
+
+  size_t size = GET_SIZE(HDRP(ptr));
+
+  if (heap_listp == 0){
+    mm_init();
+  }
+
+  PUT(HDRP(ptr), PACK(size, 0));
+  PUT(FTRP(ptr), PACK(size, 0));
+  coalesce(ptr);
+}
+
+/*
+ * mm_realloc - Shrink in place or grow into a free next block,
+ *     otherwise fall back to malloc, copy and free
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+  void *newptr;
+  size_t asize;
+  size_t oldsize;
+
+  /* If size == 0 then this is just free, and we return NULL. */
+  if(size == 0) {
+    mm_free(ptr);
+    return 0;
+  }
+
+  /* If oldptr is NULL, then this is just malloc. */
+  if(ptr == NULL) {
+    return mm_malloc(size);
+  }
+  if (size > MAX_SIZE)
+    return NULL;
+
+  oldsize = GET_SIZE(HDRP(ptr));
+  if (size <= DSIZE)
+    asize = 2*DSIZE;
+  else
+    asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+
+  if (asize <= oldsize) {
+    replace(ptr, asize);
+    return ptr;
+  } else {
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
+    size_t next_size = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+
+    if (!next_alloc && (oldsize + next_size) >= asize) {
+      remove_free_block(NEXT_BLKP(ptr));
+      PUT(HDRP(ptr), PACK(oldsize + next_size, 1));
+      PUT(FTRP(ptr), PACK(oldsize + next_size, 1));
+      replace(ptr, asize);
+      return ptr;
+    } else {
+      if ((newptr = mm_malloc(size)) == NULL)
+        return 0;
+      memcpy(newptr, ptr, oldsize - DSIZE);
+      mm_free(ptr);
+      return newptr;
+    }
+  }
+}
+
+/*
+ * mm_memalign - Allocate a block of size bytes whose payload is aligned
+ *     to align bytes, a power of two: allocate align bytes more and free
+ *     the space before the aligned payload and after the request as
+ *     blocks of their own
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+  char *bp, *p;
+  size_t csize, asize;
+
+  /* Reject bad alignments, and requests too big for any block once the
+     alignment slack is added */
+  if (size == 0 || (align & (align - 1)) != 0 ||
+      align > MAX_SIZE - 2*DSIZE || size > MAX_SIZE - 2*DSIZE - align)
+    return NULL;
+  if (align <= DSIZE)
+    return mm_malloc(size);
+  if ((bp = mm_malloc(size + align + 2*DSIZE)) == NULL)
+    return NULL;
+
+  p = (char *)(((size_t)bp + 2*DSIZE + align - 1) & ~(align - 1));
+  csize = GET_SIZE(HDRP(bp)) - (p - bp);
+
+  /* The request keeps a block of the size mm_malloc would give it */
+  if (size <= DSIZE)
+    asize = 2*DSIZE;
+  else
+    asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+  if (csize - asize < 2*DSIZE)
+    asize = csize;
+  PUT(HDRP(p), PACK(asize, 1));
+  PUT(FTRP(p), PACK(asize, 1));
+  PUT(HDRP(bp), PACK(p - bp, 1));
+  PUT(FTRP(bp), PACK(p - bp, 1));
+  if (asize < csize) {
+    PUT(HDRP(NEXT_BLKP(p)), PACK(csize - asize, 1));
+    PUT(FTRP(NEXT_BLKP(p)), PACK(csize - asize, 1));
+    mm_free(NEXT_BLKP(p));
+  }
+  mm_free(bp);
+  return p;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into ptrs, one at a
+ *     time. Return the number of blocks allocated.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+  size_t i;
+
+  for (i = 0; i < n && (ptrs[i] = mm_malloc(size)) != NULL; i++)
+    ;
+  return i;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, one at a time
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    mm_free(ptrs[i]);
+}
+
+/*
+ * mm_free_blocks - Call visit with the size of every free block
+ */
+void mm_free_blocks(void (*visit)(size_t size))
+{
+  char *bp;
+
+  if (heap_listp == 0)
+    return;
+  for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+    if (!GET_ALLOC(HDRP(bp)))
+      visit(GET_SIZE(HDRP(bp)));
+}
+
+/* Policies and entry points of the package, for the driver */
+mm_ops_t mm_ops = {
+  "mm-tlsf", "two-level segregated", "good fit", "grow into next block",
+  mm_init, mm_malloc, mm_free, mm_realloc, mm_memalign,
+  mm_malloc_batch, mm_free_batch, mm_free_blocks, 0 /* single thread */
+};
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * extend_heap - Extend heap with free block and return its block pointer
+ */
+static void *extend_heap(size_t words)
+{
+  char *bp;
+  size_t size;
+
+  /* Allocate an even number of words to maintain alignment */
+  size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+  if (size > INT_MAX || (long)(bp = mem_sbrk(size)) == -1)
+    return NULL;
+
+  /* Initialize free block header/footer and the epilogue header */
+  PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
+  PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+
+  /* Coalesce if the previous block was free */
+  return coalesce(bp);
+}
+
+/*
+ * place - Place block of asize bytes at start of free block bp
+ *         and split if remainder would be at least minimum block size
+ */
+static void place(void *bp, size_t asize)
+{
+  remove_free_block(bp);
+  replace(bp, asize);
+}
+
+/*
+ * replace - Shrink allocated or unlinked block bp to asize bytes and
+ *           return the remainder to the free lists if it is big enough
+ */
+static void replace(void *bp, size_t asize)
+{
+  size_t csize = GET_SIZE(HDRP(bp));
+
+  if ((csize - asize) >= (2*DSIZE)) {
+    PUT(HDRP(bp), PACK(asize, 1));
+    PUT(FTRP(bp), PACK(asize, 1));
+    bp = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(csize-asize, 0));
+    PUT(FTRP(bp), PACK(csize-asize, 0));
+    coalesce(bp);
+  }
+  else {
+    PUT(HDRP(bp), PACK(csize, 1));
+    PUT(FTRP(bp), PACK(csize, 1));
+  }
+}
+
+/*
+ * find_fit - Find a fit for a block with asize bytes. Rounding the
+ *     request up to the next class boundary means any block of the
+ *     returned list fits, so no list is ever walked.
+ */
+static void *find_fit(size_t asize)
+{
+  int fl, sl;
+
+  mapping_search(asize, &fl, &sl);
+  if (fl >= FL_INDEX_COUNT)
+    return NULL;
+  return search_suitable_block(&fl, &sl);
+}
+
+/*
+ * coalesce - Boundary tag coalescing. Return ptr to coalesced block
+ */
+static void *coalesce(void *bp)
+{
+  size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+  size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+  size_t size = GET_SIZE(HDRP(bp));
+
+  if (prev_alloc && next_alloc) {            /* Case 1 */
+    insert_free_block(bp);
+    return bp;
+  }
+
+  else if (prev_alloc && !next_alloc) {      /* Case 2 */
+    remove_free_block(NEXT_BLKP(bp));
+
+    size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size,0));
+
+    insert_free_block(bp);
+  }
+
+  else if (!prev_alloc && next_alloc) {      /* Case 3 */
+    remove_free_block(PREV_BLKP(bp));
+
+    size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+    PUT(FTRP(bp), PACK(size, 0));
+    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+    bp = PREV_BLKP(bp);
+
+    insert_free_block(bp);
+  }
+
+  else {                                     /* Case 4 */
+    remove_free_block(NEXT_BLKP(bp));
+    remove_free_block(PREV_BLKP(bp));
+
+    size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
+      GET_SIZE(FTRP(NEXT_BLKP(bp)));
+    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+    PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+    bp = PREV_BLKP(bp);
+
+    insert_free_block(bp);
+  }
+  return bp;
+}
+
+/*
+ * Free list operating functions
+ */
+static void init_free_lists() {
+  int fl, sl;
+
+  fl_bitmap = 0;
+  for (fl = 0; fl < FL_INDEX_COUNT; fl++) {
+    sl_bitmap[fl] = 0;
+    for (sl = 0; sl < SL_INDEX_COUNT; sl++)
+      blocks[fl][sl] = 0;
+  }
+}
+
+static void insert_free_block(void *bp) {
+  int fl, sl;
+
+  mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+  if (blocks[fl][sl]) SET_PREV(blocks[fl][sl], bp);
+  SET_PREV(bp, NULL);
+  SET_NEXT(bp, blocks[fl][sl]);
+  blocks[fl][sl] = bp;
+
+  fl_bitmap |= 1U << fl;
+  sl_bitmap[fl] |= 1U << sl;
+}
+
+static void remove_free_block(void *bp) {
+  int fl, sl;
+  void *prev = GET_PREV(bp);
+  void *next = GET_NEXT(bp);
+
+  mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+  if (prev) SET_NEXT(prev, next);
+  else blocks[fl][sl] = next;
+  if (next) SET_PREV(next, prev);
+
+  /* Clear the bitmap bits once the list runs empty */
+  if (blocks[fl][sl] == 0) {
+    sl_bitmap[fl] &= ~(1U << sl);
+    if (sl_bitmap[fl] == 0)
+      fl_bitmap &= ~(1U << fl);
+  }
+}
+
+/*
+ * mapping_insert - Compute the list (fl, sl) that holds blocks of size bytes
+ */
+static void mapping_insert(size_t size, int *fli, int *sli) {
+  int fl, sl;
+
+  if (size < SMALL_BLOCK_SIZE) {
+    /* Small blocks share first level 0, one list per DSIZE */
+    fl = 0;
+    sl = (int)size >> ALIGN_SIZE_LOG2;
+  } else {
+    fl = FLS(size);
+    sl = (int)(size >> (fl - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+    fl -= (FL_INDEX_SHIFT - 1);
+  }
+  *fli = fl;
+  *sli = sl;
+}
+
+/*
+ * mapping_search - Like mapping_insert, but round size up to the next
+ *     class so that every block of the resulting list is big enough
+ */
+static void mapping_search(size_t size, int *fli, int *sli) {
+  if (size >= SMALL_BLOCK_SIZE)
+    size += (1U << (FLS(size) - SL_INDEX_COUNT_LOG2)) - 1;
+  mapping_insert(size, fli, sli);
+}
+
+/*
+ * search_suitable_block - Return the head of the first non-empty list at
+ *     or above (fl, sl), updating fl and sl to that list, or NULL
+ */
+static void *search_suitable_block(int *fli, int *sli) {
+  int fl = *fli;
+  unsigned int sl_map = sl_bitmap[fl] & (~0U << *sli);
+  unsigned int fl_map;
+
+  if (!sl_map) {
+    /* Nothing left in this first level; go to the next non-empty one */
+    fl_map = (fl + 1 < 32) ? fl_bitmap & (~0U << (fl + 1)) : 0;
+    if (!fl_map)
+      return NULL;
+    fl = FFS(fl_map);
+    *fli = fl;
+    sl_map = sl_bitmap[fl];
+  }
+  *sli = FFS(sl_map);
+
+  return blocks[fl][*sli];
+}
+
+/*
+ * debug helper functions
+ */
+static void printblock(void *bp)
+{
+  size_t hsize, halloc, fsize, falloc;
+
+  checkheap(0);
+  hsize = GET_SIZE(HDRP(bp));
+  halloc = GET_ALLOC(HDRP(bp));
+  fsize = GET_SIZE(FTRP(bp));
+  falloc = GET_ALLOC(FTRP(bp));
+
+  if (hsize == 0) {
+    printf("%p: EOL\n", bp);
+    return;
+  }
+
+  printf("%p: header: [%ld:%c] footer: [%ld:%c]\n", bp,
+         (long int)hsize, (halloc ? 'a' : 'f'),
+         (long int)fsize, (falloc ? 'a' : 'f'));
+}
+
+static void checkblock(void *bp)
+{
+  if ((size_t)bp % 8)
+    printf("Error: %p is not doubleword aligned\n", bp);
+  if (GET(HDRP(bp)) != GET(FTRP(bp)))
+    printf("Error: header does not match footer\n");
+}
+
+/*
+ * checkheap - Minimal check of the heap and of the list bitmaps
+ */
+void checkheap(int verbose)
+{
+  char *bp = heap_listp;
+  int fl, sl;
+
+  if (verbose)
+    printf("Heap (%p):\n", heap_listp);
+
+  if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp)))
+    printf("Bad prologue header\n");
+  checkblock(heap_listp);
+
+  for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+    if (verbose)
+      printblock(bp);
+    checkblock(bp);
+  }
+
+  if (verbose)
+    printblock(bp);
+  if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+    printf("Bad epilogue header\n");
+
+  for (fl = 0; fl < FL_INDEX_COUNT; fl++) {
+    if (!(fl_bitmap & (1U << fl)) != !sl_bitmap[fl])
+      printf("Error: first-level bitmap out of sync at %d\n", fl);
+    for (sl = 0; sl < SL_INDEX_COUNT; sl++)
+      if (!(sl_bitmap[fl] & (1U << sl)) != !blocks[fl][sl])
+        printf("Error: second-level bitmap out of sync at %d/%d\n", fl, sl);
+  }
+}
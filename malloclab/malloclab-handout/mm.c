@@ -6,9 +6,11 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -34,9 +36,18 @@ team_t team = {
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
 
+/* Largest request: the length of its block must fit in a header word */
+#define MAX_SIZE  ((size_t)~0x7U - 2*DSIZE)
+
+#define REALLOC_SLACK 8     /* Blocks moved to grow get 1/8 more room */
+
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
 
+/* Header bit telling that the previous block is allocated. Only free
+   blocks carry a footer, so PREV_BLKP is valid only when it is clear */
+#define PREV_ALLOC   0x2
+
 /* Read and write a word at address p */
 #define GET(p)       (*(unsigned int *)(p))
 #define PUT(p, val)  (*(unsigned int *)(p) = (val))
@@ -44,6 +55,11 @@ team_t team = {
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Set or clear the previous-block-allocated bit of the header at p */
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)
@@ -53,43 +69,189 @@ team_t team = {
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* Free list links are stored as 32-bit offsets from the start of the heap,
+   so they take one word on 32- and 64-bit machines alike. Offset 0 is the
+   alignment padding word, which is never a block, and stands for NULL */
+#define PTR2OFF(p)  ((p) ? (unsigned int)((char *)(p) - heap_base) : 0)
+#define OFF2PTR(o)  ((o) ? (void *)(heap_base + (o)) : NULL)
+#if MAX_HEAP > 0xffffffffUL
+#error "Free list offsets are 32 bits: MAX_HEAP must be under 4 GB"
+#endif
+
 /* Given block ptr bp, compute/update address of next and previous free blocks
    in the same list */
-#define GET_PREV(bp)      (void *)(*(unsigned int *)(bp))
-#define GET_NEXT(bp)      (void *)(*((unsigned int *)(bp) + 1))
-#define SET_PREV(bp, val) (*(unsigned int *)(bp) = (unsigned int)(val))
-#define SET_NEXT(bp, val) (*((unsigned int *)(bp) + 1) = (unsigned int)(val))
+#define GET_PREV(bp)      OFF2PTR(*(unsigned int *)(bp))
+#define GET_NEXT(bp)      OFF2PTR(*((unsigned int *)(bp) + 1))
+#define SET_PREV(bp, val) (*(unsigned int *)(bp) = PTR2OFF(val))
+#define SET_NEXT(bp, val) (*((unsigned int *)(bp) + 1) = PTR2OFF(val))
+
+/* Free blocks go in NCLASSES classes by size: lists of blocks up to 16,
+   32, ..., TREE_MIN bytes, then a class for all larger blocks. A bitmap
+   has a bit set for every class that is not empty */
+#ifndef NCLASSES
+#define NCLASSES   10       /* Lists up to 4096 bytes, then the tree */
+#endif
+#if NCLASSES < 2 || NCLASSES > 32
+#error "NCLASSES must be between 2 and 32"
+#endif
+#define TREE_CLASS (NCLASSES - 1)
+#define TREE_MIN   ((size_t)16 << (NCLASSES - 2))
+
+/* Free blocks larger than TREE_MIN bytes are not kept in a list but in a
+   splay tree ordered by (size, address). Given block ptr bp, compute/update
+   its left and right children, which reuse the prev/next words */
+#define GET_LEFT(bp)       GET_PREV(bp)
+#define GET_RIGHT(bp)      GET_NEXT(bp)
+#define SET_LEFT(bp, val)  SET_PREV(bp, val)
+#define SET_RIGHT(bp, val) SET_NEXT(bp, val)
+
+/* The word after the links of a tree node holds the time it was freed,
+   counted in calls to free_block */
+#define GET_STAMP(bp)      GET((char *)(bp) + DSIZE)
+#define SET_STAMP(bp, val) PUT((char *)(bp) + DSIZE, val)
+
+/* Tree nodes of PURGE_MIN bytes or more, big enough to hold whole pages,
+   are also on the idle list, oldest first, until they are purged. The
+   two words after the stamp link them. A purged node is linked to itself */
+#define PURGE_MIN          (1<<13)
+#define GET_OLDER(bp)      OFF2PTR(*((unsigned int *)(bp) + 3))
+#define GET_NEWER(bp)      OFF2PTR(*((unsigned int *)(bp) + 4))
+#define SET_OLDER(bp, val) (*((unsigned int *)(bp) + 3) = PTR2OFF(val))
+#define SET_NEWER(bp, val) (*((unsigned int *)(bp) + 4) = PTR2OFF(val))
+#define IS_IDLE(bp) \
+  (GET_SIZE(HDRP(bp)) >= PURGE_MIN && GET_OLDER(bp) != (void *)(bp))
+
+/* Free memory is given back to the system in two ways. Free space at the
+   end of the heap above TRIM_THRESHOLD bytes is trimmed off, and every
+   PURGE_INTERVAL frees the pages inside idle nodes that stayed free for
+   PURGE_AGE frees are released */
+#define TRIM_THRESHOLD (1<<16)
+#define TOP_PAD        CHUNKSIZE   /* Free space left at the heap end */
+#define PURGE_INTERVAL (1<<10)
+#define PURGE_AGE      (1<<12)
+
+/* Freed blocks of up to FASTBIN_MAX bytes are not coalesced at once but
+   cached in fast bins, LIFO lists with one block size each, and stay marked
+   allocated. The bins are consolidated into the free lists when a request
+   finds no fit, or when they hold more than FASTBIN_LIMIT bytes */
+#ifndef FASTBIN_MAX
+#define FASTBIN_MAX   512
+#endif
+#define FASTBIN_LIMIT (1<<16)
+
+/* Requests of up to SLAB_MAX bytes are served by a slab front end. It cuts
+   runs, back-end blocks of RUNSIZE bytes whose payload starts a page, into
+   equal slots with a bitmap of the free ones. The last word of the page is
+   the header of the next block, so runs can follow each other. Slots have
+   no header: the run map tells whether a pointer lies in a run, and the
+   run header at the start of the page gives its slot size */
+#define RUN_SHIFT   12
+#define RUNSIZE     (1<<RUN_SHIFT)
+#define SLAB_MAX    128
+#define NSLABS      (SLAB_MAX / DSIZE)       /* Slot sizes 8, 16, ..., 128 */
+#define RUN_WORDS   (RUNSIZE / DSIZE / 32)   /* Bitmap words for 8-byte slots */
+#define RUN_HDRSIZE ((sizeof(run_t) + DSIZE-1) & ~(DSIZE-1))
+
+/* Slots of a power of two bytes up to a cache line are aligned to their
+   size, so that they never straddle a line. SLOT_BASE is the offset of
+   the first slot in a run of slot-byte slots */
+#define CACHELINE   64
+#define SLOT_ALIGN(slot) (((slot) & ((slot)-1)) || (slot) > CACHELINE ? DSIZE : (slot))
+#define SLOT_BASE(slot)  ((RUN_HDRSIZE + SLOT_ALIGN(slot)-1) & ~(SLOT_ALIGN(slot)-1))
+
+/* Run holding address p, and whether p lies in a run at all. Pointers
+   outside the heap are not in a run */
+#define RUN_INDEX(p) ((size_t)((char *)(p) - heap_base) >> RUN_SHIFT)
+#define RUN_OF(p)   ((run_t *)(heap_base + (((char *)(p) - heap_base) & ~(RUNSIZE-1))))
+#define IS_RUN(p)   (RUN_INDEX(p) < sizeof(run_map) && run_map[RUN_INDEX(p)])
+
+/* Requests of MMAP_THRESHOLD bytes or more get a region of their own from
+   mem_map. The header of such a block has the MAPPED bit and the length of
+   the whole region, and the word before it the offset of the payload in
+   the region: DSIZE, or more if the payload had to be aligned */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (1<<17)
+#endif
+#define MAPPED      0x4
+#define IS_MAPPED(bp) (GET(HDRP(bp)) & MAPPED)
+#define GET_LEAD(bp)  GET((char *)(bp) - DSIZE)
+
+/* Bit-scan helper: index of lowest set bit of a nonzero word */
+#define FFS(x)  (__builtin_ctz(x))
+
+typedef struct {
+  unsigned int links[2];        /* Prev/next run of the class, see GET_PREV */
+  unsigned short nslots;        /* Slots in the run */
+  unsigned short nfree;         /* Free slots in the run */
+  unsigned short slot;          /* Slot size (bytes) */
+  unsigned short base;          /* Offset of the first slot, SLOT_BASE */
+  unsigned int map[RUN_WORDS];  /* Bit set for every free slot */
+} run_t;
 
 /* Global variables */
 static char *heap_listp = 0;  /* Pointer to first block */
+static char *heap_base = 0;   /* First heap byte, base of link offsets */
+static unsigned int free_clock; /* Calls to free_block so far */
+
+/* Free block lists by class, and the root of the splay tree of larger
+   blocks in the last; bit c of nonempty is set when class c has blocks */
+static void *roots[NCLASSES];
+static unsigned int nonempty;
 
-/* Pointers to free block lists */
-static void *root_16;
-static void *root_32;
-static void *root_64;
-static void *root_128;
-static void *root_256;
-static void *root_512;
-static void *root_1024;
-static void *root_2048;
-static void *root_4096;
-static void *root_etc;
+/* Ends of the idle list of tree nodes not purged yet */
+static void *idle_oldest, *idle_newest;
+
+/* Fast bins, indexed by block size / DSIZE, and the bytes they hold */
+static void *fastbins[FASTBIN_MAX / DSIZE + 1];
+static size_t fastbin_bytes;
+
+/* Runs with free slots, one list per slot size, and the pages that are runs */
+static run_t *slab_runs[NSLABS];
+static unsigned char run_map[MAX_HEAP >> RUN_SHIFT];
 
 /* Function prototypes for internal helper routines */
 static void *extend_heap(size_t words);
 static void place(void *bp, size_t asize);
-static void replace(void *bp, size_t asize);
+static size_t adjust_size(size_t size);
 static void *find_fit(size_t asize);
+static void *find_aligned_fit(size_t asize, size_t align);
 static void *coalesce(void *bp);
+static void *grow_block(void *bp, size_t asize);
+static void free_tail(void *bp, size_t asize);
+static void carve(void *bp, size_t asize, size_t n, void **ptrs);
+static int ptr_cmp(const void *a, const void *b);
+static void free_block(void *bp);
+static void consolidate(void);
+static void trim_heap(void *bp);
+static void purge(void);
+static void idle_remove(void *bp);
+
+static void *slab_malloc(size_t size);
+static size_t slab_malloc_batch(size_t size, size_t n, void **ptrs);
+static void slab_free(void *ptr);
+static run_t *new_run(size_t slot);
+static void *alloc_run(void);
+static void *alloc_aligned(size_t asize, size_t align);
+static char *align_payload(char *bp, size_t align);
+static void unlink_run(run_t *run);
+static void *map_block(size_t size);
+static void *map_aligned(size_t size, size_t align);
+static size_t map_length(size_t size);
 
 static void init_free_root();
 static void insert_free_block(void *bp);
 static void remove_free_block(void *bp);
-static void **get_free_rootp(size_t asize);
-static void **get_greater_rootp(void **rootp);
+static int get_class(size_t asize);
+
+static int tree_cmp(size_t size, void *addr, void *bp);
+static void *splay(void *t, size_t size, void *addr);
+static void tree_insert(void *bp);
+static void tree_remove(void *bp);
+static void *tree_best_fit(size_t asize);
 
 static void printblock(void *bp);
 static void checkblock(void *bp);
+static void checkrun(run_t *run);
 static void checkheap(int verbose);
 
 /*
@@ -104,7 +266,14 @@ void mm_check() {
  */
 int mm_init(void)
 {
+  heap_base = mem_heap_lo();
   init_free_root();
+  memset(slab_runs, 0, sizeof(slab_runs));
+  memset(run_map, 0, sizeof(run_map));
+  memset(fastbins, 0, sizeof(fastbins));
+  fastbin_bytes = 0;
+  free_clock = 0;
+  idle_oldest = idle_newest = NULL;
 
   /* Create the initial empty heap */
   if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1)
@@ -112,7 +281,7 @@ int mm_init(void)
   PUT(heap_listp, 0);                          /* Alignment padding */
   PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */ 
   PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
-  PUT(heap_listp + (3*WSIZE), PACK(0, 1));     /* Epilogue header */
+  PUT(heap_listp + (3*WSIZE), PACK(0, PREV_ALLOC | 1)); /* Epilogue header */
   heap_listp += (2*WSIZE);
 
   /* Extend the empty heap with a free block of CHUNKSIZE bytes */
@@ -135,18 +304,29 @@ void *mm_malloc(size_t size)
     mm_init();
   }
 
-  /* Ignore spurious requests */
-  if (size == 0)
+  /* Ignore spurious requests, and ones too big for any block */
+  if (size == 0 || size > MAX_SIZE)
     return NULL;
 
-  /* Adjust block size to include overhead and alignment reqs. */
-  if (size <= DSIZE)
-    asize = 2*DSIZE;
-  else
-    asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+  if (size <= SLAB_MAX)
+    return slab_malloc(size);
+  if (size >= MMAP_THRESHOLD)
+    return map_block(size);
 
-  /* Search the free list for a fit */
-  if ((bp = find_fit(asize)) != NULL) {
+  /* Adjust block size to include the header and alignment reqs. */
+  asize = adjust_size(size);
+
+  /* Reuse a recently freed block of this size */
+  if (asize <= FASTBIN_MAX && (bp = fastbins[asize / DSIZE]) != NULL) {
+    fastbins[asize / DSIZE] = GET_NEXT(bp);
+    fastbin_bytes -= asize;
+    return bp;
+  }
+
+  /* Search the free list for a fit, with the fast bins merged in if
+     there is none */
+  if ((bp = find_fit(asize)) != NULL ||
+      (fastbin_bytes && (consolidate(), bp = find_fit(asize)) != NULL)) {
     place(bp, asize);
     return bp;
   }
@@ -165,18 +345,27 @@ void *mm_malloc(size_t size)
  */
 void mm_free(void *ptr)
 {
+  size_t size;
+
   if (ptr == 0)
     return;
 
-  size_t size = GET_SIZE(HDRP(ptr));
-
   if (heap_listp == 0){
     mm_init();
   }
 
-  PUT(HDRP(ptr), PACK(size, 0));
-  PUT(FTRP(ptr), PACK(size, 0));
-  coalesce(ptr);
+  if (IS_RUN(ptr))
+    slab_free(ptr);
+  else if (IS_MAPPED(ptr))
+    mem_unmap((char *)ptr - GET_LEAD(ptr), GET_SIZE(HDRP(ptr)));
+  else if ((size = GET_SIZE(HDRP(ptr))) <= FASTBIN_MAX) {
+    SET_NEXT(ptr, fastbins[size / DSIZE]);
+    fastbins[size / DSIZE] = ptr;
+    if ((fastbin_bytes += size) > FASTBIN_LIMIT)
+      consolidate();
+  }
+  else
+    free_block(ptr);
 }
 
 /*
@@ -220,7 +409,8 @@ void *mm_realloc(void *ptr, size_t size)
 
   void *newptr;
   size_t asize;
-  size_t oldsize = GET_SIZE(HDRP(ptr));
+  size_t oldsize;
+  size_t lead, len;
 
   /* If size == 0 then this is just free, and we return NULL. */
   if(size == 0) {
@@ -233,32 +423,227 @@ void *mm_realloc(void *ptr, size_t size)
     return mm_malloc(size);
   }
 
-  if (size <= DSIZE)
-    asize = 2*DSIZE;
-  else
-    asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
-    
+  if (size > MAX_SIZE)
+    return NULL;
+
+  /* Slots cannot grow: move to a bigger slot or a back-end block */
+  if (IS_RUN(ptr)) {
+    oldsize = RUN_OF(ptr)->slot;
+    if (size <= oldsize)
+      return ptr;
+    if ((newptr = mm_malloc(size)) == NULL)
+      return 0;
+    memcpy(newptr, ptr, oldsize);
+    mm_free(ptr);
+    return newptr;
+  }
+
+  /* Mapped blocks are resized with mem_remap, which does not copy, unless
+     they become small enough for the heap */
+  if (IS_MAPPED(ptr)) {
+    oldsize = GET_SIZE(HDRP(ptr));
+    if (size >= MMAP_THRESHOLD) {
+      lead = GET_LEAD(ptr);
+      len = map_length(size + lead - DSIZE);
+
+      /* The header holds the length in one word */
+      if (len > (unsigned int)~0x7 ||
+          (newptr = mem_remap((char *)ptr - lead, oldsize, len)) == (void *)-1)
+        return 0;
+      PUT((char *)newptr + lead - WSIZE, PACK(len, MAPPED | 1));
+      return (char *)newptr + lead;
+    }
+    if ((newptr = mm_malloc(size)) == NULL)
+      return 0;
+    memcpy(newptr, ptr, size);
+    mm_free(ptr);
+    return newptr;
+  }
+
+  oldsize = GET_SIZE(HDRP(ptr));
+  asize = adjust_size(size);
+
+  /* Shrinking keeps the block unless more than half of it goes: trimming
+     a little would let small blocks settle right behind it and stop it
+     from growing in place again */
   if (asize <= oldsize) {
-    replace(ptr, asize);
+    if (oldsize - asize > oldsize / 2)
+      free_tail(ptr, asize);
     return ptr;
   } else {
-      size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
-      size_t next_size = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-
-      if (!next_alloc && (oldsize + next_size) >= asize) {
-        remove_free_block(NEXT_BLKP(ptr));
-        PUT(HDRP(ptr), PACK(oldsize + next_size, 1));
-        PUT(FTRP(ptr), PACK(oldsize + next_size, 1));
-        return ptr;
-      } else {
-        newptr = mm_malloc(size);
-        memcpy(newptr, ptr, oldsize);
-        mm_free(ptr);
+      /* Blocks that outgrow MMAP_THRESHOLD move to a mapping */
+      if (size < MMAP_THRESHOLD && (newptr = grow_block(ptr, asize)) != NULL)
         return newptr;
-      }
+
+      /* A block that must move to grow is likely to grow again. Slack
+         in proportion to its size keeps the copying linear overall */
+      size += size / REALLOC_SLACK;
+      if ((newptr = mm_malloc(size)) == NULL)
+        return 0;
+      memcpy(newptr, ptr, oldsize - WSIZE);
+      mm_free(ptr);
+      return newptr;
     }
 }
 
+/*
+ * mm_memalign - Allocate a block of size bytes whose payload is aligned
+ *     to align bytes, a power of two
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+  size_t slot;
+
+  if (heap_listp == 0){
+    mm_init();
+  }
+
+  /* Reject bad alignments, and requests too big for any block once the
+     alignment slack is added */
+  if (size == 0 || (align & (align - 1)) != 0 ||
+      align > MAX_SIZE - 2*DSIZE || size > MAX_SIZE - 2*DSIZE - align)
+    return NULL;
+  if (align <= DSIZE)
+    return mm_malloc(size);
+  if (size >= MMAP_THRESHOLD)
+    return map_aligned(size, align);
+
+  /* Slots of a multiple of align bytes are aligned if the first one is */
+  slot = (size + align - 1) & ~(align - 1);
+  if (slot <= SLAB_MAX && SLOT_BASE(slot) % align == 0)
+    return slab_malloc(slot);
+  return alloc_aligned(adjust_size(size), align);
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into ptrs. The blocks
+ *     the fast bin of their size does not hold are carved side by side
+ *     from as few free blocks as possible. Return the number allocated.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+  size_t asize, total, k;
+  size_t i = 0;
+  char *bp;
+
+  if (heap_listp == 0){
+    mm_init();
+  }
+
+  if (size == 0)
+    return 0;
+
+  if (size <= SLAB_MAX)
+    return slab_malloc_batch(size, n, ptrs);
+  if (size >= MMAP_THRESHOLD) {
+    for (; i < n && (ptrs[i] = map_block(size)) != NULL; i++)
+      ;
+    return i;
+  }
+
+  asize = adjust_size(size);
+  if (asize <= FASTBIN_MAX) {
+    for (; i < n && (bp = fastbins[asize / DSIZE]) != NULL; i++) {
+      fastbins[asize / DSIZE] = GET_NEXT(bp);
+      fastbin_bytes -= asize;
+      ptrs[i] = bp;
+    }
+  }
+  if (i == n)
+    return n;
+
+  /* Carve the others from one free block that holds them all if there
+     is one, else from each free block that holds some in turn, and
+     only then from new heap */
+  if (fastbin_bytes && find_fit(asize * (n - i)) == NULL)
+    consolidate();
+  while (i < n) {
+    total = (n - i <= MAX_HEAP / asize) ? (n - i) * asize : MAX_HEAP;
+    if ((bp = find_fit(total)) == NULL && (bp = find_fit(asize)) == NULL &&
+        (bp = extend_heap(MAX(total, CHUNKSIZE)/WSIZE)) == NULL)
+      break;
+    k = GET_SIZE(HDRP(bp)) / asize;
+    k = (k < n - i) ? k : n - i;
+    carve(bp, asize, k, ptrs + i);
+    i += k;
+  }
+  return i;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs. The array is sorted by
+ *     address, so that blocks that follow each other are merged into one
+ *     before they are coalesced with their neighbours.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+  size_t i, j, size;
+  char *bp;
+
+  if (heap_listp == 0){
+    mm_init();
+  }
+
+  /* Blocks from mm_malloc_batch mostly come sorted already */
+  for (i = 1; i < n && (char *)ptrs[i-1] <= (char *)ptrs[i]; i++)
+    ;
+  if (i < n)
+    qsort(ptrs, n, sizeof(void *), ptr_cmp);
+
+  for (i = 0; i < n; i = j) {
+    bp = ptrs[i];
+    j = i + 1;
+    if (bp == NULL || IS_RUN(bp) || IS_MAPPED(bp)) {
+      mm_free(bp);
+      continue;
+    }
+
+    size = GET_SIZE(HDRP(bp));
+    for (; j < n && ptrs[j] == bp + size; j++)
+      size += GET_SIZE(HDRP(ptrs[j]));
+    if (j == i + 1)
+      mm_free(bp);
+    else {
+      PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | 1));
+      free_block(bp);
+    }
+  }
+}
+
+/*
+ * mm_free_blocks - Call visit with the size of every free block: the
+ *     free blocks of the heap, the blocks in the fast bins, which are
+ *     still marked allocated, and each free slot of the slab runs
+ */
+void mm_free_blocks(void (*visit)(size_t size))
+{
+  char *bp;
+  run_t *run;
+  size_t i;
+
+  if (heap_listp == 0)
+    return;
+
+  for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+    if (!GET_ALLOC(HDRP(bp)))
+      visit(GET_SIZE(HDRP(bp)));
+    else if (IS_RUN(bp))
+      for (run = (run_t *)bp, i = 0; i < run->nfree; i++)
+        visit(run->slot);
+  }
+
+  for (i = 0; i < FASTBIN_MAX / DSIZE + 1; i++)
+    for (bp = fastbins[i]; bp; bp = GET_NEXT(bp))
+      visit(i * DSIZE);
+}
+
+/* Policies and entry points of the package, for the driver */
+mm_ops_t mm_ops = {
+  "mm", "segregated + splay tree, slabs", "first fit, best fit > 4KB", "grow both ways, 1/8 slack",
+  mm_init, mm_malloc, mm_free, mm_realloc, mm_memalign,
+  mm_malloc_batch, mm_free_batch, mm_free_blocks, 0 /* single thread */
+};
+
 /* 
  * The remaining routines are internal helper routines 
  */
@@ -273,11 +658,12 @@ static void *extend_heap(size_t words)
 
   /* Allocate an even number of words to maintain alignment */
   size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-  if ((long)(bp = mem_sbrk(size)) == -1)
+  if (size > INT_MAX || (long)(bp = mem_sbrk(size)) == -1)
     return NULL;
 
-  /* Initialize free block header/footer and the epilogue header */
-  PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
+  /* Initialize free block header/footer and the epilogue header. The
+     old epilogue header, now ours, knows whether the last block is free */
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); /* Free block header */
   PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
   PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
 
@@ -294,57 +680,498 @@ static void place(void *bp, size_t asize)
   size_t csize = GET_SIZE(HDRP(bp));
   remove_free_block(bp);
 
+  /* Free blocks always follow an allocated block */
   if ((csize - asize) >= (2*DSIZE)) {
-    PUT(HDRP(bp), PACK(asize, 1));
-    PUT(FTRP(bp), PACK(asize, 1));
+    PUT(HDRP(bp), PACK(asize, PREV_ALLOC | 1));
     bp = NEXT_BLKP(bp);
-    PUT(HDRP(bp), PACK(csize-asize, 0));
+    PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC));
     PUT(FTRP(bp), PACK(csize-asize, 0));
     insert_free_block(bp);
   }
   else {
-    PUT(HDRP(bp), PACK(csize, 1));
-    PUT(FTRP(bp), PACK(csize, 1));
+    PUT(HDRP(bp), PACK(csize, PREV_ALLOC | 1));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
   }
 }
 
-static void replace(void *bp, size_t asize) {
-  size_t csize = GET_SIZE(HDRP(bp));
+/*
+ * grow_block - Grow allocated block bp to asize bytes in place: into a
+ *     free next block, back into a free previous block, moving the
+ *     payload down, or onto new heap when bp is the last block. What it
+ *     takes beyond asize and some slack is freed again. Return the grown
+ *     block, or NULL if it cannot grow.
+ */
+static void *grow_block(void *bp, size_t asize)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  char *next = NEXT_BLKP(bp);
+  char *newbp = bp;
+  size_t next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+  size_t prev_size = GET_PREV_ALLOC(HDRP(bp)) ? 0 : GET_SIZE(HDRP(PREV_BLKP(bp)));
+
+  if (size + next_size >= asize)
+    prev_size = 0;                      /* Forward is enough, no move */
+  else if (prev_size + size + next_size < asize) {
+    /* Only growing the heap helps, and only if nothing follows */
+    if (GET_SIZE(HDRP(next_size ? NEXT_BLKP(next) : next)) != 0)
+      return NULL;
+    if (extend_heap(MAX(asize - prev_size - size - next_size, 2*DSIZE) / WSIZE) == NULL)
+      return NULL;
+    next_size = GET_SIZE(HDRP(next));
+  }
 
-  if ((csize - asize) >= (2*DSIZE)) {
-    PUT(HDRP(bp), PACK(asize, 1));
-    PUT(FTRP(bp), PACK(asize, 1));
-    bp = NEXT_BLKP(bp);
-    PUT(HDRP(bp), PACK(csize-asize, 0));
-    PUT(FTRP(bp), PACK(csize-asize, 0));
-    insert_free_block(bp);
+  if (next_size)
+    remove_free_block(next);
+  if (prev_size) {
+    newbp = PREV_BLKP(bp);
+    remove_free_block(newbp);
+    memmove(newbp, bp, size - WSIZE);
+  }
+
+  /* A free previous block always follows an allocated one */
+  size += prev_size + next_size;
+  PUT(HDRP(newbp), PACK(size, (prev_size ? PREV_ALLOC : GET_PREV_ALLOC(HDRP(newbp))) | 1));
+  SET_PREV_ALLOC(HDRP(NEXT_BLKP(newbp)));
+  free_tail(newbp, DSIZE * ((asize + asize / REALLOC_SLACK) / DSIZE));
+  return newbp;
+}
+
+/*
+ * free_tail - Shrink allocated block bp to asize bytes, freeing the rest
+ *     as a block of its own if it is big enough to be one
+ */
+static void free_tail(void *bp, size_t asize)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+
+  if (asize > size || size - asize < 2*DSIZE)
+    return;
+  PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+  bp = NEXT_BLKP(bp);
+  PUT(HDRP(bp), PACK(size - asize, PREV_ALLOC | 1));
+  free_block(bp);
+}
+
+/*
+ * carve - Allocate n blocks of asize bytes side by side at the start of
+ *     free block bp, which holds them all, and put their pointers in ptrs
+ */
+static void carve(void *bp, size_t asize, size_t n, void **ptrs)
+{
+  size_t csize = GET_SIZE(HDRP(bp)) - n * asize;
+  char *p = bp;
+  size_t i;
+
+  remove_free_block(bp);
+  for (i = 0; i < n; i++, p += asize) {
+    PUT(HDRP(p), PACK(asize, PREV_ALLOC | 1));
+    ptrs[i] = p;
+  }
+
+  /* The rest is split off as in place, or goes to the last block */
+  if (csize >= 2*DSIZE) {
+    PUT(HDRP(p), PACK(csize, PREV_ALLOC));
+    PUT(FTRP(p), PACK(csize, 0));
+    insert_free_block(p);
   }
   else {
-    PUT(HDRP(bp), PACK(csize, 1));
-    PUT(FTRP(bp), PACK(csize, 1));
+    p -= asize;
+    PUT(HDRP(p), PACK(asize + csize, PREV_ALLOC | 1));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(p)));
   }
 }
 
+/*
+ * free_block - Give allocated back-end block bp back to the free lists
+ */
+static void free_block(void *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+  PUT(FTRP(bp), PACK(size, 0));
+  CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+  bp = coalesce(bp);
+
+  size = GET_SIZE(HDRP(bp));
+  if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 && size >= TRIM_THRESHOLD)
+    trim_heap(bp);
+  if (++free_clock % PURGE_INTERVAL == 0)
+    purge();
+
+  /* Much free space means the heap is emptying: do not let blocks in the
+     fast bins pin it */
+  if (size >= FASTBIN_LIMIT && fastbin_bytes)
+    consolidate();
+}
+
+/*
+ * consolidate - Free and coalesce every block in the fast bins
+ */
+static void consolidate(void)
+{
+  size_t i;
+  void *bp;
+
+  fastbin_bytes = 0;
+  for (i = 0; i < FASTBIN_MAX / DSIZE + 1; i++) {
+    while ((bp = fastbins[i]) != NULL) {
+      fastbins[i] = GET_NEXT(bp);
+      free_block(bp);
+    }
+  }
+}
+
+/*
+ * trim_heap - Shrink the heap so that free block bp at its end keeps
+ *     only TOP_PAD bytes
+ */
+static void trim_heap(void *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+
+  remove_free_block(bp);
+  mem_trim(size - TOP_PAD);
+  PUT(HDRP(bp), PACK(TOP_PAD, PREV_ALLOC)); /* Free block header */
+  PUT(FTRP(bp), PACK(TOP_PAD, 0));          /* Free block footer */
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));     /* New epilogue header */
+  insert_free_block(bp);
+}
+
+/*
+ * purge - Release the pages of the idle nodes that have been free for
+ *     PURGE_AGE frees, and take them off the idle list. Links, stamp
+ *     and footer stay resident.
+ */
+static void purge(void)
+{
+  void *t;
+
+  while ((t = idle_oldest) != NULL && free_clock - GET_STAMP(t) >= PURGE_AGE) {
+    idle_remove(t);
+    SET_OLDER(t, t);
+    mem_release((char *)t + 3*DSIZE, GET_SIZE(HDRP(t)) - 3*DSIZE - DSIZE);
+  }
+}
+
+/*
+ * idle_remove - Take tree node bp off the idle list
+ */
+static void idle_remove(void *bp)
+{
+  if (GET_OLDER(bp)) SET_NEWER(GET_OLDER(bp), GET_NEWER(bp));
+  else idle_oldest = GET_NEWER(bp);
+  if (GET_NEWER(bp)) SET_OLDER(GET_NEWER(bp), GET_OLDER(bp));
+  else idle_newest = GET_OLDER(bp);
+}
+
+/*
+ * slab_malloc - Take the first free slot of a run of the smallest slot
+ *     size that holds size bytes
+ */
+static void *slab_malloc(size_t size)
+{
+  size_t slot = DSIZE * ((size + (DSIZE-1)) / DSIZE);
+  run_t *run = slab_runs[slot / DSIZE - 1];
+  unsigned int i, bit;
+
+  if (run == NULL && (run = new_run(slot)) == NULL)
+    return NULL;
+
+  for (i = 0; run->map[i] == 0; i++)
+    ;
+  bit = FFS(run->map[i]);
+  run->map[i] &= ~(1u << bit);
+
+  /* Full runs leave the list until a slot is freed again */
+  if (--run->nfree == 0)
+    unlink_run(run);
+  return (char *)run + run->base + (32*i + bit) * slot;
+}
+
+/*
+ * slab_malloc_batch - Take n slots for size bytes, emptying the bitmap
+ *     of each run in turn. Return the number of slots taken.
+ */
+static size_t slab_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+  size_t slot = DSIZE * ((size + (DSIZE-1)) / DSIZE);
+  size_t i = 0;
+  run_t *run;
+  unsigned int j, bit;
+
+  while (i < n) {
+    if ((run = slab_runs[slot / DSIZE - 1]) == NULL &&
+        (run = new_run(slot)) == NULL)
+      break;
+    for (j = 0; i < n && run->nfree; j++) {
+      for (; i < n && run->map[j]; run->nfree--) {
+        bit = FFS(run->map[j]);
+        run->map[j] &= run->map[j] - 1;
+        ptrs[i++] = (char *)run + run->base + (32*j + bit) * slot;
+      }
+    }
+    if (run->nfree == 0)
+      unlink_run(run);
+  }
+  return i;
+}
+
+/*
+ * slab_free - Mark slot ptr free. A run that becomes empty goes back to
+ *     the back end, unless it is the last run of its slot size.
+ */
+static void slab_free(void *ptr)
+{
+  run_t *run = RUN_OF(ptr);
+  run_t **rootp = &slab_runs[run->slot / DSIZE - 1];
+  unsigned int i = ((char *)ptr - (char *)run - run->base) / run->slot;
+
+  run->map[i / 32] |= 1u << (i % 32);
+
+  if (run->nfree++ == 0) {
+    if (*rootp) SET_PREV(*rootp, run);
+    SET_PREV(run, NULL);
+    SET_NEXT(run, *rootp);
+    *rootp = run;
+  }
+  else if (run->nfree == run->nslots && (*rootp != run || run->links[1])) {
+    unlink_run(run);
+    run_map[((char *)run - heap_base) >> RUN_SHIFT] = 0;
+    free_block(run);
+  }
+}
+
+/*
+ * new_run - Make a run of slot-byte slots and put it on its list
+ */
+static run_t *new_run(size_t slot)
+{
+  run_t *run;
+  unsigned int i;
+
+  if ((run = alloc_run()) == NULL)
+    return NULL;
+  run_map[((char *)run - heap_base) >> RUN_SHIFT] = 1;
+
+  run->base = SLOT_BASE(slot);
+  run->nslots = run->nfree = (RUNSIZE - WSIZE - run->base) / slot;
+  run->slot = slot;
+  for (i = 0; i < RUN_WORDS; i++) {
+    if (32*(i+1) <= run->nslots)
+      run->map[i] = ~0u;
+    else if (32*i < run->nslots)
+      run->map[i] = (1u << (run->nslots % 32)) - 1;
+    else
+      run->map[i] = 0;
+  }
+
+  SET_PREV(run, NULL);
+  SET_NEXT(run, NULL);
+  slab_runs[slot / DSIZE - 1] = run;
+  return run;
+}
+
+/*
+ * alloc_run - Allocate a back-end block whose payload is a whole page.
+ *     memlib maps the heap page aligned, so the page is also a run for
+ *     RUN_OF.
+ */
+static void *alloc_run(void)
+{
+  return alloc_aligned(RUNSIZE, RUNSIZE);
+}
+
+/*
+ * alloc_aligned - Allocate a back-end block of asize bytes whose payload
+ *     is aligned to align bytes, a power of two. The free space in front
+ *     of the payload stays a free block.
+ */
+static void *alloc_aligned(size_t asize, size_t align)
+{
+  size_t csize, gap;
+  char *bp, *p;
+
+  if (fastbin_bytes && find_aligned_fit(asize, align) == NULL)
+    consolidate();
+  if ((bp = find_aligned_fit(asize, align)) == NULL) {
+    /* Grow the heap just enough to fit the block at its end */
+    bp = (char *)mem_heap_hi() + 1;
+    csize = 0;
+    if (!GET_PREV_ALLOC(HDRP(bp))) {
+      bp = PREV_BLKP(bp);
+      csize = GET_SIZE(HDRP(bp));
+    }
+    p = align_payload(bp, align);
+    if (p - bp + asize > csize &&
+        (bp = extend_heap(MAX(p - bp + asize - csize, 2*DSIZE) / WSIZE)) == NULL)
+      return NULL;
+  }
+  p = align_payload(bp, align);
+
+  /* Split off the space in front of the payload */
+  if ((gap = p - bp) != 0) {
+    csize = GET_SIZE(HDRP(bp));
+    remove_free_block(bp);
+    PUT(HDRP(bp), PACK(gap, PREV_ALLOC));
+    PUT(FTRP(bp), PACK(gap, 0));
+    insert_free_block(bp);
+    PUT(HDRP(p), PACK(csize - gap, 0));
+    PUT(FTRP(p), PACK(csize - gap, 0));
+    insert_free_block(p);
+  }
+
+  place(p, asize);
+  if (gap)
+    CLR_PREV_ALLOC(HDRP(p));
+  return p;
+}
+
+/*
+ * align_payload - First address from free block bp on that is aligned
+ *     to align bytes and leaves either nothing or room for a free block
+ *     before it
+ */
+static char *align_payload(char *bp, size_t align)
+{
+  char *p = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+
+  if (p != bp && p - bp < 2*DSIZE)
+    p += MAX(align, 2*DSIZE);
+  return p;
+}
+
+/*
+ * map_block - Allocate a block of size bytes in a region of its own
+ */
+static void *map_block(size_t size)
+{
+  size_t len = map_length(size);
+  char *p;
+
+  /* The header holds the length in one word */
+  if (len > (unsigned int)~0x7 || (p = mem_map(len)) == (void *)-1)
+    return NULL;
+  PUT(p, DSIZE);                          /* Payload offset */
+  PUT(p + WSIZE, PACK(len, MAPPED | 1));  /* Block header */
+  return p + DSIZE;
+}
+
+/*
+ * map_aligned - Allocate a block of size bytes whose payload is aligned
+ *     to align bytes in a region of its own: map align bytes more, and
+ *     give back the pages past the block
+ */
+static void *map_aligned(size_t size, size_t align)
+{
+  size_t len = map_length(size + align);
+  size_t lead, need;
+  char *p, *q;
+
+  if (len > (unsigned int)~0x7 || (p = mem_map(len)) == (void *)-1)
+    return NULL;
+  lead = (((size_t)p + DSIZE + align - 1) & ~(align - 1)) - (size_t)p;
+  need = map_length(size + lead - DSIZE);
+  if (need < len && (q = mem_remap(p, len, need)) != (void *)-1) {
+    p = q;
+    len = need;
+  }
+  PUT(p + lead - DSIZE, lead);                   /* Payload offset */
+  PUT(p + lead - WSIZE, PACK(len, MAPPED | 1));  /* Block header */
+  return p + lead;
+}
+
+/*
+ * map_length - Length of the region for a mapped size-byte block
+ */
+static size_t map_length(size_t size)
+{
+  size_t pagesize = mem_pagesize();
+
+  return (size + DSIZE + pagesize - 1) & ~(pagesize - 1);
+}
+
+/*
+ * unlink_run - Take run off the list of its slot size
+ */
+static void unlink_run(run_t *run)
+{
+  run_t **rootp = &slab_runs[run->slot / DSIZE - 1];
+  run_t *prev = GET_PREV(run);
+  run_t *next = GET_NEXT(run);
+
+  if (prev) SET_NEXT(prev, next);
+  else *rootp = next;
+  if (next) SET_PREV(next, prev);
+}
+
+/*
+ * ptr_cmp - Order pointers by address, for qsort
+ */
+static int ptr_cmp(const void *a, const void *b)
+{
+  char *p = *(char * const *)a;
+  char *q = *(char * const *)b;
+
+  return (p > q) - (p < q);
+}
+
+/*
+ * adjust_size - Block size for a size-byte payload: the payload plus a
+ *     header, rounded up to DSIZE and at least the minimum free block
+ */
+static size_t adjust_size(size_t size)
+{
+  if (size <= DSIZE + WSIZE)
+    return 2*DSIZE;
+  return DSIZE * ((size + (WSIZE) + (DSIZE-1)) / DSIZE);
+}
+
 /* 
  * find_fit - Find a fit for a block with asize bytes 
  */
 static void *find_fit(size_t asize)
 {
-  void **rootp;
+  int c = get_class(asize);
+  unsigned int larger;
   void *bp;
 
-  rootp = get_free_rootp(asize);
-  while (rootp) {
-    // first fit search
-    bp = *rootp;
-    while (bp) {
-      if (asize <= GET_SIZE(HDRP(bp))) return bp;
-      bp = GET_NEXT(bp);
-    }
-    rootp = get_greater_rootp(rootp);
+  // best fit search among the large blocks
+  if (c == TREE_CLASS)
+    return tree_best_fit(asize);
+
+  // first fit search in the class of asize, whose blocks may be smaller
+  for (bp = roots[c]; bp; bp = GET_NEXT(bp))
+    if (asize <= GET_SIZE(HDRP(bp)))
+      return bp;
+
+  // every block of a larger class fits: take the first of the next one
+  if ((larger = nonempty & (~0u << c << 1)) == 0)
+    return NULL; /* No fit */
+  c = FFS(larger);
+  return (c == TREE_CLASS) ? tree_best_fit(asize) : roots[c];
+}
+
+/*
+ * find_aligned_fit - Find a fit for a block with asize bytes whose
+ *     payload is aligned to align bytes, leaving room for a free block
+ *     before it
+ */
+static void *find_aligned_fit(size_t asize, size_t align)
+{
+  unsigned int lists;
+  char *bp;
+
+  // first fit search of the lists, with the padding each block needs
+  lists = nonempty & (~0u << get_class(asize)) & ~(1u << TREE_CLASS);
+  for (; lists; lists &= lists - 1) {
+    for (bp = roots[FFS(lists)]; bp; bp = GET_NEXT(bp))
+      if (align_payload(bp, align) - bp + asize <= GET_SIZE(HDRP(bp)))
+        return bp;
   }
 
-  return NULL; /* No fit */
+  // any large block this big holds an aligned payload
+  return tree_best_fit(asize + align + 2*DSIZE);
 }
 
 /*
@@ -352,7 +1179,7 @@ static void *find_fit(size_t asize)
  */
 static void *coalesce(void *bp) 
 {
-  size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+  size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
   size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
   size_t size = GET_SIZE(HDRP(bp));
 
@@ -365,7 +1192,7 @@ static void *coalesce(void *bp)
     remove_free_block(NEXT_BLKP(bp));
 
     size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-    PUT(HDRP(bp), PACK(size, 0));
+    PUT(HDRP(bp), PACK(size, PREV_ALLOC));
     PUT(FTRP(bp), PACK(size,0));
 
     insert_free_block(bp);
@@ -376,7 +1203,7 @@ static void *coalesce(void *bp)
 
     size += GET_SIZE(HDRP(PREV_BLKP(bp)));
     PUT(FTRP(bp), PACK(size, 0));
-    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+    PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
     bp = PREV_BLKP(bp);
 
     insert_free_block(bp);
@@ -388,7 +1215,7 @@ static void *coalesce(void *bp)
 
     size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
       GET_SIZE(FTRP(NEXT_BLKP(bp)));
-    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+    PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
     PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
     bp = PREV_BLKP(bp);
 
@@ -401,61 +1228,187 @@ static void *coalesce(void *bp)
  * Free list/tree operating functions
  */
 static void init_free_root() {
-  root_16 = 0;
-  root_32 = 0;
-  root_64 = 0;
-  root_128 = 0;
-  root_256 = 0;
-  root_512 = 0;
-  root_1024 = 0;
-  root_2048 = 0;
-  root_4096 = 0;
-  root_etc = 0;
+  int c;
+
+  for (c = 0; c < NCLASSES; c++)
+    roots[c] = 0;
+  nonempty = 0;
 }
 
 static void insert_free_block(void *bp) {
-  void **rootp = get_free_rootp(GET_SIZE(HDRP(bp)));
+  int c = get_class(GET_SIZE(HDRP(bp)));
+
+  nonempty |= 1u << c;
+  if (c == TREE_CLASS) {
+    tree_insert(bp);
+    return;
+  }
 
-  if (*rootp) SET_PREV(*rootp, bp);
+  if (roots[c]) SET_PREV(roots[c], bp);
   SET_PREV(bp, NULL);
-  SET_NEXT(bp, *rootp);
-  *rootp = bp;
+  SET_NEXT(bp, roots[c]);
+  roots[c] = bp;
 }
 
 static void remove_free_block(void *bp) {
-  void **rootp = get_free_rootp(GET_SIZE(HDRP(bp)));
+  int c = get_class(GET_SIZE(HDRP(bp)));
   void *prev = GET_PREV(bp);
   void *next = GET_NEXT(bp);
 
-  if (prev) SET_NEXT(prev, next);
-  else *rootp = next;
-  if (next) SET_PREV(next, prev);
+  if (c == TREE_CLASS)
+    tree_remove(bp);
+  else {
+    if (prev) SET_NEXT(prev, next);
+    else roots[c] = next;
+    if (next) SET_PREV(next, prev);
+  }
+  if (roots[c] == NULL)
+    nonempty &= ~(1u << c);
+}
+
+/*
+ * get_class - Class of blocks of asize bytes: c for sizes up to 16 << c,
+ *     found with one bit-scan of asize - 1, and the tree above TREE_MIN
+ */
+static int get_class(size_t asize) {
+  int c = 8*sizeof(long) - 4 - __builtin_clzl((asize - 1) | 15);
+
+  return (c < TREE_CLASS) ? c : TREE_CLASS;
+}
+
+/*
+ * tree_cmp - Compare key (size, addr) with the key of free block bp
+ */
+static int tree_cmp(size_t size, void *addr, void *bp) {
+  size_t bsize = GET_SIZE(HDRP(bp));
+
+  if (size != bsize) return (size < bsize) ? -1 : 1;
+  if (addr != bp) return ((char *)addr < (char *)bp) ? -1 : 1;
+  return 0;
+}
+
+/*
+ * splay - Top-down splay of tree t around key (size, addr). Returns the
+ *     new root, which is the node with that key if there is one, and
+ *     otherwise its predecessor or successor.
+ */
+static void *splay(void *t, size_t size, void *addr) {
+  void *l = NULL, *r = NULL;        /* Roots of the left and right trees */
+  void *lmax = NULL, *rmin = NULL;  /* Where to hang the next nodes */
+  void *y;
+  int c;
+
+  if (t == NULL)
+    return NULL;
+
+  while ((c = tree_cmp(size, addr, t)) != 0) {
+    if (c < 0) {
+      if ((y = GET_LEFT(t)) == NULL)
+        break;
+      if (tree_cmp(size, addr, y) < 0) {   /* rotate right */
+        SET_LEFT(t, GET_RIGHT(y));
+        SET_RIGHT(y, t);
+        t = y;
+        if (GET_LEFT(t) == NULL)
+          break;
+      }
+      if (rmin) SET_LEFT(rmin, t);         /* link right */
+      else r = t;
+      rmin = t;
+      t = GET_LEFT(t);
+    } else {
+      if ((y = GET_RIGHT(t)) == NULL)
+        break;
+      if (tree_cmp(size, addr, y) > 0) {   /* rotate left */
+        SET_RIGHT(t, GET_LEFT(y));
+        SET_LEFT(y, t);
+        t = y;
+        if (GET_RIGHT(t) == NULL)
+          break;
+      }
+      if (lmax) SET_RIGHT(lmax, t);        /* link left */
+      else l = t;
+      lmax = t;
+      t = GET_RIGHT(t);
+    }
+  }
+
+  /* Reassemble */
+  if (lmax) {
+    SET_RIGHT(lmax, GET_LEFT(t));
+    SET_LEFT(t, l);
+  }
+  if (rmin) {
+    SET_LEFT(rmin, GET_RIGHT(t));
+    SET_RIGHT(t, r);
+  }
+  return t;
+}
+
+static void tree_insert(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  void *t = splay(roots[TREE_CLASS], size, bp);
+
+  SET_STAMP(bp, free_clock);
+  if (size >= PURGE_MIN) {
+    SET_OLDER(bp, idle_newest);
+    SET_NEWER(bp, NULL);
+    if (idle_newest) SET_NEWER(idle_newest, bp);
+    else idle_oldest = bp;
+    idle_newest = bp;
+  }
+
+  if (t == NULL) {
+    SET_LEFT(bp, NULL);
+    SET_RIGHT(bp, NULL);
+  } else if (tree_cmp(size, bp, t) < 0) {
+    SET_LEFT(bp, GET_LEFT(t));
+    SET_RIGHT(bp, t);
+    SET_LEFT(t, NULL);
+  } else {
+    SET_RIGHT(bp, GET_RIGHT(t));
+    SET_LEFT(bp, t);
+    SET_RIGHT(t, NULL);
+  }
+  roots[TREE_CLASS] = bp;
 }
 
-static void **get_free_rootp(size_t asize) {
-  if (asize <= 16) return &root_16;
-  else if (asize <= 32) return &root_32;
-  else if (asize <= 64) return &root_64;
-  else if (asize <= 128) return &root_128;
-  else if (asize <= 256) return &root_256;
-  else if (asize <= 512) return &root_512;
-  else if (asize <= 1024) return &root_1024;
-  else if (asize <= 2048) return &root_2048;
-  else if (asize <= 4096) return &root_4096;
-  else return &root_etc;
+static void tree_remove(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  void *t = splay(roots[TREE_CLASS], size, bp);
+  void *x;
+
+  assert(t == bp);
+  if (IS_IDLE(bp))
+    idle_remove(bp);
+  if (GET_LEFT(t) == NULL) {
+    roots[TREE_CLASS] = GET_RIGHT(t);
+  } else {
+    /* All keys on the left are smaller, so this brings up its maximum */
+    x = splay(GET_LEFT(t), size, bp);
+    SET_RIGHT(x, GET_RIGHT(t));
+    roots[TREE_CLASS] = x;
+  }
 }
 
-static void **get_greater_rootp(void **rootp) {
-  if (rootp == &root_16) return &root_32;
-  else if (rootp == &root_32) return &root_64;
-  else if (rootp == &root_64) return &root_128;
-  else if (rootp == &root_128) return &root_256;
-  else if (rootp == &root_256) return &root_512;
-  else if (rootp == &root_512) return &root_1024;
-  else if (rootp == &root_1024) return &root_2048;
-  else if (rootp == &root_2048) return &root_4096;
-  else if (rootp == &root_4096) return &root_etc;
-  else return NULL;
+/*
+ * tree_best_fit - Return the smallest (lowest addressed on ties) large
+ *     free block of at least asize bytes, or NULL
+ */
+static void *tree_best_fit(size_t asize) {
+  void *t;
+
+  if ((t = roots[TREE_CLASS] = splay(roots[TREE_CLASS], asize, NULL)) == NULL)
+    return NULL;
+  if (GET_SIZE(HDRP(t)) >= asize)
+    return t;
+
+  /* The root is the predecessor: its successor is the right minimum */
+  if ((t = GET_RIGHT(t)) == NULL)
+    return NULL;
+  while (GET_LEFT(t))
+    t = GET_LEFT(t);
+  return t;
 }
 
 /*
@@ -463,38 +1416,59 @@ static void **get_greater_rootp(void **rootp) {
  */
 static void printblock(void *bp) 
 {
-  size_t hsize, halloc, fsize, falloc;
+  size_t hsize, halloc, hprev, fsize;
 
   checkheap(0);
   hsize = GET_SIZE(HDRP(bp));
   halloc = GET_ALLOC(HDRP(bp));  
-  fsize = GET_SIZE(FTRP(bp));
-  falloc = GET_ALLOC(FTRP(bp));  
+  hprev = GET_PREV_ALLOC(HDRP(bp));
 
   if (hsize == 0) {
     printf("%p: EOL\n", bp);
     return;
   }
 
-  printf("%p: header: [%ld:%c] footer: [%ld:%c]\n", bp, 
-         (long int)hsize, (halloc ? 'a' : 'f'), 
-         (long int)fsize, (falloc ? 'a' : 'f')); 
+  /* Allocated blocks have no footer */
+  if (halloc) {
+    printf("%p: header: [%ld:%c%c]\n", bp, 
+           (long int)hsize, (hprev ? 'a' : 'f'), 'a');
+    return;
+  }
+
+  fsize = GET_SIZE(FTRP(bp));
+  printf("%p: header: [%ld:%c%c] footer: [%ld]\n", bp, 
+         (long int)hsize, (hprev ? 'a' : 'f'), 'f', (long int)fsize); 
 }
 
 static void checkblock(void *bp) 
 {
   if ((size_t)bp % 8)
     printf("Error: %p is not doubleword aligned\n", bp);
-  if (GET(HDRP(bp)) != GET(FTRP(bp)))
+  if (!GET_ALLOC(HDRP(bp)) && (GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp))))
     printf("Error: header does not match footer\n");
 }
 
+static void checkrun(run_t *run)
+{
+  unsigned int i, nfree = 0;
+
+  if ((char *)run != (char *)RUN_OF(run))
+    printf("Error: run %p is not page aligned\n", run);
+  for (i = 0; i < RUN_WORDS; i++)
+    nfree += __builtin_popcount(run->map[i]);
+  if (nfree != run->nfree)
+    printf("Error: run %p has %u free slots, not %u\n", run, nfree,
+           (unsigned int)run->nfree);
+}
+
 /* 
  * checkheap - Minimal check of the heap for consistency 
  */
 void checkheap(int verbose) 
 {
-  char *bp = heap_listp;
+  char *bp = heap_listp, *next;
+  size_t prev_alloc = 1;
+  size_t i;
 
   if (verbose)
     printf("Heap (%p):\n", heap_listp);
@@ -503,14 +1477,38 @@ void checkheap(int verbose)
     printf("Bad prologue header\n");
   checkblock(heap_listp);
 
-  for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+  for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
     if (verbose) 
       printblock(bp);
     checkblock(bp);
+    if (!GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc)
+      printf("Error: %p has a stale prev-allocated bit\n", bp);
+    prev_alloc = GET_ALLOC(HDRP(bp));
+    if (prev_alloc && IS_RUN(bp))
+      checkrun((run_t *)bp);
   }
 
   if (verbose)
     printblock(bp);
   if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
     printf("Bad epilogue header\n");
+  if (!GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc)
+    printf("Error: epilogue has a stale prev-allocated bit\n");
+
+  for (i = 0; i < FASTBIN_MAX / DSIZE + 1; i++)
+    for (bp = fastbins[i]; bp; bp = GET_NEXT(bp))
+      if (!GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != i * DSIZE)
+        printf("Error: %p does not belong in fast bin %d\n", bp, (int)i);
+
+  for (i = 0; i < NCLASSES; i++)
+    if (!(nonempty & (1u << i)) != !roots[i])
+      printf("Error: class bitmap out of sync at %d\n", (int)i);
+
+  for (bp = idle_oldest; bp; bp = next) {
+    next = GET_NEWER(bp);
+    if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) < PURGE_MIN)
+      printf("Error: %p does not belong on the idle list\n", bp);
+    if ((next != NULL) ? GET_OLDER(next) != bp : idle_newest != bp)
+      printf("Error: idle list broken at %p\n", bp);
+  }
 }
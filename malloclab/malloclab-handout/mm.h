@@ -1,9 +1,60 @@
 #include <stdio.h>
 
+/*
+ * A package built with -DMM_PREFIX=<p> names its globals p##mm_init and
+ * so on, so that several packages can be linked into one driver.
+ */
+#ifdef MM_PREFIX
+#define MM_CAT(a, b)  a##b
+#define MM_XCAT(a, b) MM_CAT(a, b)
+#define mm_init         MM_XCAT(MM_PREFIX, mm_init)
+#define mm_malloc       MM_XCAT(MM_PREFIX, mm_malloc)
+#define mm_free         MM_XCAT(MM_PREFIX, mm_free)
+#define mm_realloc      MM_XCAT(MM_PREFIX, mm_realloc)
+#define mm_memalign     MM_XCAT(MM_PREFIX, mm_memalign)
+#define mm_malloc_batch MM_XCAT(MM_PREFIX, mm_malloc_batch)
+#define mm_free_batch   MM_XCAT(MM_PREFIX, mm_free_batch)
+#define mm_free_blocks  MM_XCAT(MM_PREFIX, mm_free_blocks)
+#define mm_check        MM_XCAT(MM_PREFIX, mm_check)
+#define mm_ops          MM_XCAT(MM_PREFIX, mm_ops)
+#define team            MM_XCAT(MM_PREFIX, team)
+#endif
+
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+
+/* Allocate n blocks of size bytes into ptrs[0..n-1] and return how many
+   were allocated; free the n blocks in ptrs, which may be reordered */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **ptrs);
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* Call visit with the size in bytes of every free block in the heap */
+extern void mm_free_blocks(void (*visit)(size_t size));
+
+/*
+ * Every package describes its policies and exports its entry points in
+ * an mm_ops table, through which the driver calls it.
+ */
+typedef struct {
+    char *name;     /* package name */
+    char *lists;    /* free block organization */
+    char *fit;      /* placement policy */
+    char *resize;   /* realloc policy */
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*memalign)(size_t align, size_t size);
+    size_t (*malloc_batch)(size_t size, size_t n, void **ptrs);
+    void (*free_batch)(void **ptrs, size_t n);
+    void (*free_blocks)(void (*visit)(size_t size)); /* NULL if it can't */
+    int threads;    /* may several threads call it at once? */
+} mm_ops_t;
+
+extern mm_ops_t mm_ops;
 
 
 /* 
@@ -0,0 +1,163 @@
+/*
+ * perfctr.c - Count hardware events, such as cache and TLB misses, with
+ *     the perf_event_open system call of Linux
+ *
+ * The events are opened as one group, led by the first that opens, so
+ * that they are counted over exactly the same instructions. Events the
+ * machine does not have are left out; on other systems, or where the
+ * kernel does not allow it, none can be opened and perf_open says so.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perfctr.h"
+
+char *perf_names[PERF_EVENTS] = {
+    "cycles", "instr", "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss", "faults"
+};
+
+char perf_error[128] = "";
+
+static int fds[PERF_EVENTS];  /* counter of each event, or -1 */
+static int leader = -1;       /* the first counter opened */
+
+#ifdef __linux__
+
+/* Type and config of each event, for perf_event_attr */
+#define CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct {
+    unsigned type;
+    unsigned long long config;
+} events[PERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}
+};
+
+/* What read returns for one counter */
+typedef struct {
+    unsigned long long value;
+    unsigned long long time_enabled;  /* ns the group was enabled */
+    unsigned long long time_running;  /* ns it was on the PMU */
+} reading_t;
+
+/*
+ * perf_open - Open a counter for every event the machine can count
+ */
+int perf_open(void)
+{
+    struct perf_event_attr attr;
+    int i, n = 0;
+
+    perf_close();
+    for (i = 0; i < PERF_EVENTS; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = (leader < 0);  /* the leader starts the group */
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | 
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+	if (fds[i] < 0) {
+	    if (n == 0)
+		sprintf(perf_error, "perf_event_open: %s", strerror(errno));
+	    continue;
+	}
+	if (leader < 0)
+	    leader = fds[i];
+	n++;
+    }
+    return n;
+}
+
+/*
+ * perf_start - Zero and start the counters
+ */
+void perf_start(void)
+{
+    if (leader < 0)
+	return;
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/*
+ * perf_stop - Stop the counters and read them. A group that did not fit
+ *     on the counters of the machine is not counted at all, as all its
+ *     events go on the PMU together or not at all.
+ */
+void perf_stop(double *counts)
+{
+    reading_t r;
+    int i;
+
+    if (leader >= 0)
+	ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    for (i = 0; i < PERF_EVENTS; i++) {
+	counts[i] = -1;
+	if (fds[i] < 0 || read(fds[i], &r, sizeof(r)) != sizeof(r) ||
+	    r.time_running == 0)
+	    continue;
+	counts[i] = r.value;
+	if (r.time_running < r.time_enabled)  /* multiplexed: scale up */
+	    counts[i] *= (double)r.time_enabled / r.time_running;
+    }
+}
+
+#else /* !__linux__ */
+
+int perf_open(void)
+{
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+	fds[i] = -1;
+    strcpy(perf_error, "no perf_event_open on this system");
+    return 0;
+}
+
+void perf_start(void)
+{
+}
+
+void perf_stop(double *counts)
+{
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+	counts[i] = -1;
+}
+
+#endif /* __linux__ */
+
+/*
+ * perf_close - Close the counters
+ */
+void perf_close(void)
+{
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++) {
+	if (leader >= 0 && fds[i] >= 0)
+	    close(fds[i]);
+	fds[i] = -1;
+    }
+    leader = -1;
+}
@@ -0,0 +1,33 @@
+/*
+ * perfctr.h - prototypes for the hardware event counters in perfctr.c
+ */
+
+/* The events counted, in the order of their counts */
+enum {
+    PERF_CYCLES,        /* CPU cycles */
+    PERF_INSTRUCTIONS,  /* instructions retired */
+    PERF_L1D_MISSES,    /* L1 data cache read misses */
+    PERF_LLC_MISSES,    /* last level cache misses */
+    PERF_DTLB_MISSES,   /* data TLB read misses */
+    PERF_BRANCH_MISSES, /* mispredicted branches */
+    PERF_PAGE_FAULTS,   /* page faults, counted by the kernel */
+    PERF_EVENTS
+};
+
+/* Short names of the events, for tables */
+extern char *perf_names[PERF_EVENTS];
+
+/* Open a counter for every event the machine can count, in user mode
+   only; return how many were opened, and if none, why in perf_error */
+int perf_open(void);
+extern char perf_error[];
+
+/* Zero and start the counters */
+void perf_start(void);
+
+/* Stop the counters and store what they counted in counts[PERF_EVENTS],
+   with -1 for the events that could not be counted */
+void perf_stop(double *counts);
+
+/* Close the counters */
+void perf_close(void);
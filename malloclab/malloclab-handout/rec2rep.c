@@ -0,0 +1,306 @@
+/*
+ * rec2rep - Turn a log recorded by librecorder.so into a trace file
+ *
+ * usage: rec2rep [-t <thread>] <log>  > <trace>
+ *
+ * The calls of every thread, or only those of the given thread, are
+ * put in order by time and numbered by block: each block gets an id
+ * when it is allocated, which realloc keeps and free ends. Frees of
+ * blocks allocated before recording started are dropped. A block the
+ * log shows being allocated at the address of a live block ends the
+ * life of the old one first, as it must have been freed by a call the
+ * order by time put after this one. A realloc gives up its old block
+ * at the time it was called, and takes the block it returns at the
+ * time it returned, so another thread can reuse the old address in
+ * between.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "recorder.h"
+
+/* One request of the trace */
+typedef struct {
+    char type;  /* 'a', 'r', 'f' or 'm' as in the trace file */
+    int id;     /* block id */
+    int size;   /* bytes, for all but 'f' */
+    int align;  /* alignment, for 'm' */
+} op_t;
+
+/* Maps the address of each live block to its id and size */
+typedef struct {
+    unsigned long long addr;  /* 0 if the slot is empty */
+    int id;
+    int size;
+} slot_t;
+
+/* The block of a thread's realloc, between its call and its return */
+typedef struct {
+    int id;     /* -1 if none, or one we never saw */
+    int size;
+} resize_t;
+
+static rec_t *recs;          /* the log */
+static size_t *order;        /* the records to replay, by time */
+static slot_t *live;         /* open addressing table of live blocks */
+static resize_t *resizing;   /* by thread */
+static size_t live_mask;     /* its size, a power of two, minus 1 */
+
+static op_t *ops;            /* the trace being built */
+static int num_ops, num_ids;
+static long live_bytes, peak_bytes;
+
+static int rec_cmp(const void *a, const void *b);
+static size_t home(unsigned long long addr);
+static slot_t *lookup(unsigned long long addr);
+static void insert(unsigned long long addr, int id, int size);
+static void remove_slot(slot_t *s);
+static void emit(char type, int id, int size, int align);
+static int clamp_size(unsigned long long size);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    FILE *f;
+    long len;
+    size_t i, n, kept, resizes = 0;
+    int c, thread = 0, threads = 0, dropped = 0;
+    rec_t *r;
+    slot_t *s;
+    resize_t *z;
+
+    while ((c = getopt(argc, argv, "t:h")) != EOF) {
+	switch (c) {
+	case 't': /* Keep only the calls of this thread */
+	    thread = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 1)
+	usage();
+
+    /* Read the whole log */
+    if ((f = fopen(argv[optind], "rb")) == NULL) {
+	perror(argv[optind]);
+	exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+    n = len / sizeof(rec_t);
+    if ((recs = malloc(n * sizeof(rec_t) + 1)) == NULL ||
+	fread(recs, sizeof(rec_t), n, f) != n) {
+	fprintf(stderr, "rec2rep: could not read %s\n", argv[optind]);
+	exit(1);
+    }
+    fclose(f);
+
+    /* Put the calls of the threads we want in order by time */
+    if ((order = malloc(n * sizeof(size_t) + 1)) == NULL) {
+	fprintf(stderr, "rec2rep: out of memory\n");
+	exit(1);
+    }
+    for (i = kept = 0; i < n; i++) {
+	if (recs[i].thread > threads)
+	    threads = recs[i].thread;
+	if (thread == 0 || recs[i].thread == thread)
+	    order[kept++] = i;
+    }
+    n = kept;
+    qsort(order, n, sizeof(size_t), rec_cmp);
+
+    for (live_mask = 1; live_mask < 2 * n; live_mask <<= 1)
+	;
+    live = calloc(live_mask, sizeof(slot_t));
+    live_mask--;
+    ops = malloc(2 * n * sizeof(op_t) + 1);
+    resizing = malloc((threads + 1) * sizeof(resize_t));
+    if (live == NULL || ops == NULL || resizing == NULL) {
+	fprintf(stderr, "rec2rep: out of memory\n");
+	exit(1);
+    }
+    for (c = 0; c <= threads; c++)
+	resizing[c].id = -1;
+
+    /* Number the blocks and turn the calls into requests */
+    for (i = 0; i < n; i++) {
+	r = &recs[order[i]];
+	switch (r->type) {
+	case REC_FREE:
+	    if ((s = lookup(r->ptr))->addr == 0) {
+		dropped++;
+		break;
+	    }
+	    emit('f', s->id, 0, 0);
+	    remove_slot(s);
+	    break;
+
+	case REC_RESIZE:
+	    /* The old block leaves the table until the realloc returns */
+	    resizes++;
+	    z = &resizing[r->thread];
+	    z->id = -1;
+	    if ((s = lookup(r->ptr))->addr != 0) {
+		z->id = s->id;
+		z->size = s->size;
+		remove_slot(s);
+	    }
+	    break;
+
+	case REC_REALLOC:
+	    z = &resizing[r->thread];
+	    c = z->id;
+	    z->id = -1;
+	    if (r->ptr != 0 && c < 0) {
+		dropped++;     /* grows a block we never saw: a new block */
+	    }
+	    else if (r->ptr != 0 && r->result == 0) {
+		if (r->size == 0)     /* realloc(p, 0) frees p */
+		    emit('f', c, 0, 0);
+		else                  /* a failed realloc keeps p */
+		    insert(r->ptr, c, z->size);
+		break;
+	    }
+	    else if (r->ptr != 0) {
+		if ((s = lookup(r->result))->addr != 0) {
+		    emit('f', s->id, 0, 0);
+		    remove_slot(s);
+		}
+		emit('r', c, clamp_size(r->size), 0);
+		insert(r->result, c, clamp_size(r->size));
+		break;
+	    }
+	    /* realloc of NULL, or of a block we never saw, allocates */
+	case REC_MALLOC:
+	case REC_CALLOC:
+	case REC_MEMALIGN:
+	    if (r->result == 0)
+		break;
+	    if ((s = lookup(r->result))->addr != 0) {
+		emit('f', s->id, 0, 0);
+		remove_slot(s);
+	    }
+	    if (r->type == REC_MEMALIGN)
+		emit('m', num_ids, clamp_size(r->size), r->align);
+	    else
+		emit('a', num_ids, clamp_size(r->size), 0);
+	    insert(r->result, num_ids++, clamp_size(r->size));
+	    break;
+	}
+    }
+
+    /* The trace file: a header, then one request per line */
+    printf("%ld\n%d\n%d\n%d\n", peak_bytes, num_ids, num_ops, 1);
+    for (i = 0; i < (size_t)num_ops; i++) {
+	if (ops[i].type == 'f')
+	    printf("f %d\n", ops[i].id);
+	else if (ops[i].type == 'm')
+	    printf("m %d %d %d\n", ops[i].id, ops[i].align, ops[i].size);
+	else
+	    printf("%c %d %d\n", ops[i].type, ops[i].id, ops[i].size);
+    }
+
+    fprintf(stderr, "%lu calls of %d threads: %d blocks, %d requests, "
+	    "%d calls on blocks from before the recording\n",
+	    (unsigned long)(n - resizes), threads, num_ids, num_ops, dropped);
+    exit(0);
+}
+
+/*
+ * rec_cmp - Order the indexes of two records by the time of the record,
+ *     and records at the same time by where they are in the log, which
+ *     for the records of one thread is the order of its calls
+ */
+static int rec_cmp(const void *a, const void *b)
+{
+    size_t i = *(const size_t *)a, j = *(const size_t *)b;
+
+    if (recs[i].time != recs[j].time)
+	return recs[i].time < recs[j].time ? -1 : 1;
+    return (i < j) ? -1 : (i > j);
+}
+
+/*
+ * home - Return the slot where the block at addr goes if it is free
+ */
+static size_t home(unsigned long long addr)
+{
+    return ((addr >> 4) * 0x9E3779B97F4A7C15ULL >> 20) & live_mask;
+}
+
+/*
+ * lookup - Return the slot of the live block at addr, or the empty slot
+ *     where it would go
+ */
+static slot_t *lookup(unsigned long long addr)
+{
+    size_t i = home(addr);
+
+    while (live[i].addr != 0 && live[i].addr != addr)
+	i = (i + 1) & live_mask;
+    return &live[i];
+}
+
+static void insert(unsigned long long addr, int id, int size)
+{
+    slot_t *s = lookup(addr);
+
+    s->addr = addr;
+    s->id = id;
+    s->size = size;
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+}
+
+/*
+ * remove_slot - Empty slot s, moving back the blocks after it that
+ *     could not go where they wanted because s was taken
+ */
+static void remove_slot(slot_t *s)
+{
+    size_t hole = s - live, i = hole, want;
+
+    live_bytes -= s->size;
+    s->addr = 0;
+    for (;;) {
+	i = (i + 1) & live_mask;
+	if (live[i].addr == 0)
+	    return;
+	want = home(live[i].addr);
+	if (((i - want) & live_mask) >= ((i - hole) & live_mask)) {
+	    live[hole] = live[i];
+	    live[i].addr = 0;
+	    hole = i;
+	}
+    }
+}
+
+static void emit(char type, int id, int size, int align)
+{
+    ops[num_ops].type = type;
+    ops[num_ops].id = id;
+    ops[num_ops].size = size;
+    ops[num_ops].align = align;
+    num_ops++;
+}
+
+/*
+ * clamp_size - Sizes of 0, which mdriver cannot replay, become 1
+ */
+static int clamp_size(unsigned long long size)
+{
+    if (size == 0)
+	return 1;
+    return size > 0x7fffffff ? 0x7fffffff : (int)size;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: rec2rep [-t <thread>] <log>  > <trace>\n");
+    exit(1);
+}
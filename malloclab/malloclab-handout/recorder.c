@@ -0,0 +1,272 @@
+/*
+ * recorder.c - Records the allocator calls of a program into a log
+ *     that rec2rep turns into a trace file for mdriver
+ *
+ * Build librecorder.so and preload it into any program:
+ *
+ *     unix> MM_RECORD=server.rec LD_PRELOAD=./librecorder.so server
+ *     unix> ./rec2rep server.rec > traces/server.rep
+ *
+ * It takes the place of malloc, calloc, realloc, free, memalign,
+ * posix_memalign, aligned_alloc and valloc, passes each call on to the
+ * glibc allocator, and records it with the time and the calling thread.
+ * Each thread records into a buffer of its own, which takes no lock,
+ * and appends the buffer to the log with one write when it fills up,
+ * when the thread exits, and when the program exits.
+ *
+ * Blocks are stamped so that a block is always allocated before it
+ * is freed, even by another thread: allocations after they return and
+ * frees before they are made. A realloc is both, and is recorded twice:
+ * once stamped before the call, giving up the old block, and once
+ * after, with the block it returned. Only the process the recorder was
+ * preloaded into records: not its forked children, nor the programs
+ * they run, which inherit LD_PRELOAD.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "recorder.h"
+
+/* The glibc allocator, which does the real work */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t align, size_t size);
+
+/* The records of one thread not yet in the log */
+typedef struct recbuf_t {
+    struct recbuf_t *next;      /* all the buffers, for the flush at exit */
+    unsigned n;                 /* records in use */
+    rec_t recs[REC_BUFRECS];
+} recbuf_t;
+
+#define TLS __attribute__((tls_model("initial-exec"))) __thread
+
+static TLS recbuf_t *buf;       /* this thread's buffer */
+static TLS int busy;            /* in the recorder: do not record */
+static TLS unsigned short thread_id;
+
+static int fd = -1;             /* the log, or -1 if not recording */
+static recbuf_t *buffers;       /* every thread's buffer */
+static unsigned short threads;  /* threads seen so far */
+static pthread_key_t flush_key; /* flushes a thread's buffer at its exit */
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void record_init(void);
+static void record(int type, void *ptr, void *result, size_t size,
+		   size_t align, unsigned long long time);
+static unsigned long long now(void);
+static void flush(recbuf_t *b);
+static void flush_thread(void *ptr);
+static void stop_child(void);
+
+/*
+ * The interposed allocator calls
+ */
+void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+
+    record(REC_MALLOC, NULL, p, size, 0, now());
+    return p;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *p = __libc_calloc(n, size);
+
+    record(REC_CALLOC, NULL, p, n * size, 0, now());
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    unsigned long long start = now();
+    void *p = __libc_realloc(ptr, size);
+
+    if (ptr != NULL)
+	record(REC_RESIZE, ptr, NULL, size, 0, start);
+    record(REC_REALLOC, ptr, p, size, 0, now());
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+	return;
+    record(REC_FREE, ptr, NULL, 0, 0, now());
+    __libc_free(ptr);
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p = __libc_memalign(align, size);
+
+    record(REC_MEMALIGN, NULL, p, size, align, now());
+    return p;
+}
+
+int posix_memalign(void **ptrp, size_t align, size_t size)
+{
+    void *p;
+
+    if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0)
+	return EINVAL;
+    if ((p = __libc_memalign(align, size)) == NULL)
+	return ENOMEM;
+    record(REC_MEMALIGN, NULL, p, size, align, now());
+    *ptrp = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+/*
+ * record - Append a call to the buffer of the calling thread
+ */
+static void record(int type, void *ptr, void *result, size_t size,
+		   size_t align, unsigned long long time)
+{
+    rec_t *r;
+
+    if (busy)
+	return;
+    busy = 1;
+    pthread_once(&once, record_init);
+    if (fd < 0) {
+	busy = 0;
+	return;
+    }
+
+    /* A thread's first call gives it an id and a buffer */
+    if (buf == NULL) {
+	buf = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+	    buf = NULL;
+	    busy = 0;
+	    return;
+	}
+	thread_id = __atomic_add_fetch(&threads, 1, __ATOMIC_RELAXED);
+	buf->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&buffers, &buf->next, buf, 1,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	    ;
+	pthread_setspecific(flush_key, buf);
+    }
+
+    r = &buf->recs[buf->n];
+    r->time = time;
+    r->ptr = (unsigned long long)(size_t)ptr;
+    r->result = (unsigned long long)(size_t)result;
+    r->size = size;
+    r->align = align;
+    r->thread = thread_id;
+    r->type = type;
+    if (++buf->n == REC_BUFRECS)
+	flush(buf);
+    busy = 0;
+}
+
+/*
+ * record_init - Open the log, once, on the first call of any thread
+ */
+static void record_init(void)
+{
+    char *path = getenv(REC_ENV);
+    char *pid = getenv(REC_PID_ENV);
+    char mypid[32];
+
+    /* Programs run by the recording process leave its log alone */
+    snprintf(mypid, sizeof(mypid), "%d", (int)getpid());
+    if (pid != NULL && strcmp(pid, mypid) != 0)
+	return;
+    setenv(REC_PID_ENV, mypid, 1);
+
+    if (path == NULL || *path == '\0')
+	path = REC_FILE;
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    pthread_key_create(&flush_key, flush_thread);
+    pthread_atfork(NULL, NULL, stop_child);
+}
+
+/*
+ * now - Return the time in ns since boot, the same in every thread
+ */
+static unsigned long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * flush - Append the records of buffer b to the log in one write
+ */
+static void flush(recbuf_t *b)
+{
+    size_t len = b->n * sizeof(rec_t);
+    char *p = (char *)b->recs;
+    ssize_t done;
+
+    while (len > 0 && fd >= 0) {
+	if ((done = write(fd, p, len)) < 0 && errno != EINTR)
+	    break;
+	if (done > 0) {
+	    p += done;
+	    len -= done;
+	}
+    }
+    b->n = 0;
+}
+
+/*
+ * flush_thread - Flush the buffer of a thread as it exits
+ */
+static void flush_thread(void *ptr)
+{
+    busy = 1;
+    flush((recbuf_t *)ptr);
+}
+
+/*
+ * flush_all - Flush the buffers of every thread when the program exits
+ */
+static void __attribute__((destructor)) flush_all(void)
+{
+    recbuf_t *b;
+
+    busy = 1;
+    for (b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b; b = b->next)
+	flush(b);
+}
+
+/*
+ * stop_child - Drop the records a child inherits and stop recording
+ */
+static void stop_child(void)
+{
+    recbuf_t *b;
+
+    for (b = buffers; b != NULL; b = b->next)
+	b->n = 0;
+    close(fd);
+    fd = -1;
+}
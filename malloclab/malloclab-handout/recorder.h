@@ -0,0 +1,42 @@
+/*
+ * recorder.h - Format of the log written by librecorder.so, which
+ *     records the allocator calls of a real program, and read by
+ *     rec2rep, which turns the log into a trace file for mdriver
+ *
+ * The log is a sequence of records in the byte order of the machine
+ * that wrote it. Each thread fills a buffer of its own and appends it
+ * to the log in one write, so the records of different threads are
+ * interleaved in blocks; rec2rep puts them back in order by time.
+ */
+
+/* Where the log goes unless the environment variable says otherwise */
+#define REC_ENV  "MM_RECORD"
+#define REC_FILE "malloc.rec"
+
+/* Set by the recording process to its pid, so its children do not record */
+#define REC_PID_ENV "MM_RECORD_PID"
+
+/* Records a thread collects before it appends them to the log */
+#define REC_BUFRECS 4096
+
+/* The calls that are recorded */
+enum {
+    REC_MALLOC,   /* malloc(size) returned result */
+    REC_CALLOC,   /* calloc of size bytes in all returned result */
+    REC_REALLOC,  /* realloc(ptr, size) returned result */
+    REC_FREE,     /* free(ptr) */
+    REC_MEMALIGN, /* memalign, posix_memalign, aligned_alloc or valloc */
+    REC_RESIZE    /* realloc(ptr, size) was called; its REC_REALLOC,
+		     stamped when it returned, follows */
+};
+
+/* One allocator call */
+typedef struct {
+    unsigned long long time;    /* ns since boot when the call was made */
+    unsigned long long ptr;     /* block freed or reallocated */
+    unsigned long long result;  /* block returned, 0 if none */
+    unsigned long long size;    /* bytes asked for */
+    unsigned int align;         /* alignment asked for by memalign */
+    unsigned short thread;      /* 1 for the first thread to call, ... */
+    unsigned short type;        /* REC_MALLOC, ... */
+} rec_t;
@@ -0,0 +1,57 @@
+/*
+ * repconv - Convert a trace file between the .rep text format and the
+ *     binary format that mdriver maps into memory as it is
+ *
+ * usage: repconv [-r] <in> <out>
+ *
+ * The input may be in either format. The output is a binary trace file,
+ * or with -r a .rep file. mdriver reads both formats under any name,
+ * so a binary trace can take the place of its .rep file in the default
+ * tracefiles or be given with -f:
+ *
+ *     unix> ./repconv traces/big.rep traces/big.trc
+ *     unix> ./mdriver -V -f traces/big.trc
+ *
+ * A binary trace file is read only on the kind of machine that wrote it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+int verbose = 0;     /* read by read_trace */
+
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    trace_t *trace;
+    int c, text = 0;
+
+    while ((c = getopt(argc, argv, "rh")) != EOF) {
+	switch (c) {
+	case 'r': /* Write a .rep file */
+	    text = 1;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 2)
+	usage();
+
+    trace = read_trace("", argv[optind]);
+    if (write_trace(trace, argv[optind + 1], text) < 0) {
+	perror(argv[optind + 1]);
+	exit(1);
+    }
+    free_trace(trace);
+    exit(0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: repconv [-r] <in> <out>\n");
+    exit(1);
+}
@@ -0,0 +1,302 @@
+/*
+ * trace.c - Read and write the trace files that drive the malloc
+ *     packages
+ *
+ * A .rep file is parsed request by request into a freshly allocated
+ * array. A binary trace file is mapped into memory and its requests
+ * are used where they lie, so that even a trace of millions of
+ * requests is ready as soon as it is opened.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+extern int verbose;  /* -v option in mdriver.c */
+
+static int map_trace(trace_t *trace, char *path);
+static void unix_error(char *msg);
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char type[MAXLINE];
+    char path[MAXLINE];
+    char msg[MAXLINE];
+    unsigned index, size, count, align;
+    unsigned max_index = 0;
+    unsigned op_index;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trance");
+    trace->map = NULL;
+	
+    /* Read the trace file header */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if (map_trace(trace, path))
+	return trace;
+    if ((tracefile = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	unix_error(msg);
+    }
+    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+    fscanf(tracefile, "%d", &(trace->num_ids));     
+    fscanf(tracefile, "%d", &(trace->num_ops));     
+    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+    
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops = 
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in read_trace");
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in read_trace");
+    
+    /* read every request line in the trace file */
+    index = 0;
+    op_index = 0;
+    while (fscanf(tracefile, "%s", type) != EOF) {
+	switch(type[0]) {
+	case 'a':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'r':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = REALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'f':
+	    fscanf(tracefile, "%ud", &index);
+	    trace->ops[op_index].type = FREE;
+	    trace->ops[op_index].index = index;
+	    break;
+	case 'A':
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    trace->ops[op_index].type = BALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = size;
+	    index += count - 1;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'F':
+	    fscanf(tracefile, "%u %u", &index, &count);
+	    trace->ops[op_index].type = BFREE;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    break;
+	case 'm':
+	    fscanf(tracefile, "%u %u %u", &index, &align, &size);
+	    /* The driver checks results modulo the alignment */
+	    if ((int)align <= 0 || (align & (align - 1)) != 0) {
+		printf("Bogus request %u in tracefile %s: alignment %u\n",
+		       op_index, path, align);
+		exit(1);
+	    }
+	    trace->ops[op_index].type = MEMALIGN;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].align = align;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n", 
+		   type[0], path);
+	    exit(1);
+	}
+	op_index++;
+	
+    }
+    fclose(tracefile);
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+    
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    if (trace->map != NULL)   /* unmap the requests of a binary trace, */
+	munmap(trace->map, trace->map_len);
+    else                      /* or free the three arrays... */
+	free(trace->ops);
+    free(trace->blocks);      
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * map_trace - If path is a binary trace file, map it into memory, set
+ *     up trace to use its requests where they lie, and return 1;
+ *     otherwise return 0
+ */
+static int map_trace(trace_t *trace, char *path)
+{
+    trace_hdr_t *hdr;
+    traceop_t *op;
+    struct stat st;
+    char msg[MAXLINE];
+    void *map;
+    int fd, count, i;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0 ||
+	st.st_size < (off_t)sizeof(trace_hdr_t)) {
+	if (fd >= 0)
+	    close(fd);
+	return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return 0;
+    hdr = (trace_hdr_t *)map;
+    if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+	munmap(map, st.st_size);
+	return 0;
+    }
+
+    if (hdr->byte_order != 1 || hdr->op_size != sizeof(traceop_t) ||
+	hdr->num_ids < 0 || hdr->num_ops < 0 ||
+	st.st_size != (off_t)(sizeof(trace_hdr_t) + 
+			      (size_t)hdr->num_ops * sizeof(traceop_t))) {
+	printf("%s was written on another kind of machine or is truncated; "
+	       "convert it again from its .rep file\n", path);
+	exit(1);
+    }
+
+    /* The driver indexes its block arrays with the requests as they
+       are, so check every one of them once, here */
+    op = (traceop_t *)(hdr + 1);
+    for (i = 0; i < hdr->num_ops; i++, op++) {
+	count = (op->type == BALLOC || op->type == BFREE) ? op->count : 1;
+	if ((unsigned)op->type > MEMALIGN || count < 1 || op->index < 0 ||
+	    op->index > hdr->num_ids - count ||
+	    (op->type != FREE && op->type != BFREE && op->size < 0) ||
+	    (op->type == MEMALIGN &&
+	     (op->align <= 0 || (op->align & (op->align - 1)) != 0))) {
+	    printf("Bogus request %d in tracefile %s; "
+		   "convert it again from its .rep file\n", i, path);
+	    exit(1);
+	}
+    }
+
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+    trace->map = map;
+    trace->map_len = st.st_size;
+    madvise(map, st.st_size, MADV_WILLNEED);
+
+    /* The blocks are filled in as the trace runs; nothing to copy */
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL ||
+	(trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL) {
+	sprintf(msg, "malloc failed in map_trace for %s", path);
+	unix_error(msg);
+    }
+    return 1;
+}
+
+/*
+ * write_trace - Write a trace to path, as a binary trace file unless
+ *     text is set, in which case as a .rep file. Return 0 if all went
+ *     well and -1 otherwise.
+ */
+int write_trace(trace_t *trace, char *path, int text)
+{
+    FILE *f;
+    trace_hdr_t hdr;
+    traceop_t *op;
+    int i;
+
+    if ((f = fopen(path, text ? "w" : "wb")) == NULL)
+	return -1;
+
+    if (!text) {
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	hdr.byte_order = 1;
+	hdr.op_size = sizeof(traceop_t);
+	hdr.sugg_heapsize = trace->sugg_heapsize;
+	hdr.num_ids = trace->num_ids;
+	hdr.num_ops = trace->num_ops;
+	hdr.weight = trace->weight;
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, f);
+	return fclose(f) == 0 ? 0 : -1;
+    }
+
+    fprintf(f, "%d\n%d\n%d\n%d\n", trace->sugg_heapsize, trace->num_ids,
+	    trace->num_ops, trace->weight);
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	switch (op->type) {
+	case ALLOC:
+	    fprintf(f, "a %d %d\n", op->index, op->size);
+	    break;
+	case REALLOC:
+	    fprintf(f, "r %d %d\n", op->index, op->size);
+	    break;
+	case FREE:
+	    fprintf(f, "f %d\n", op->index);
+	    break;
+	case BALLOC:
+	    fprintf(f, "A %d %d %d\n", op->index, op->count, op->size);
+	    break;
+	case BFREE:
+	    fprintf(f, "F %d %d\n", op->index, op->count);
+	    break;
+	case MEMALIGN:
+	    fprintf(f, "m %d %d %d\n", op->index, op->align, op->size);
+	    break;
+	}
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* 
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg) 
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
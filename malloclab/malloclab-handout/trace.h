@@ -0,0 +1,51 @@
+/*
+ * trace.h - The trace files that drive the malloc packages, in the
+ *     text format of the .rep files and in a binary format that is
+ *     mapped into memory as it is
+ */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC, BALLOC, BFREE, MEMALIGN} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+    int count;                        /* ids index..index+count-1 of a batch */
+    int align;                        /* alignment of a memalign request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* the binary trace file ops lies in, or NULL */
+    size_t map_len;      /* ... and its length */
+} trace_t;
+
+/*
+ * A binary trace file is this header followed by the num_ops requests
+ * as traceop_t structs, as they are laid out in memory on the machine
+ * that wrote it, which is the only kind of machine that can read it.
+ */
+#define TRACE_MAGIC "MMTRACE"
+typedef struct {
+    char magic[8];       /* TRACE_MAGIC */
+    int byte_order;      /* 1, to tell the byte order */
+    int op_size;         /* sizeof(traceop_t) */
+    int sugg_heapsize;   /* as in trace_t */
+    int num_ids;
+    int num_ops;
+    int weight;
+} trace_hdr_t;
+
+/* Read a trace file of either format from dir/filename, or free it */
+trace_t *read_trace(char *dir, char *filename);
+void free_trace(trace_t *trace);
+
+/* Write a trace to path as a binary trace file or, if text is set,
+   as a .rep file; return 0 if all went well, and -1 otherwise */
+int write_trace(trace_t *trace, char *path, int text);